@@ -456,7 +456,9 @@ int easyexif::EXIFInfo::parseFrom(const unsigned char *buf, unsigned len) {
     return PARSE_EXIF_ERROR_CORRUPT;
   offs += 2;
 
-  return parseFromEXIFSegment(buf + offs, len - offs);
+  int result = parseFromEXIFSegment(buf + offs, len - offs);
+  if (this->ThumbnailLength) this->ThumbnailOffset += offs;
+  return result;
 }
 
 int easyexif::EXIFInfo::parseFrom(const string &data) {
@@ -580,6 +582,35 @@ int easyexif::EXIFInfo::parseFromEXIFSegment(const unsigned char *buf,
     }
   }
 
+  // The 4 bytes following IFD0 hold the offset to IFD1, which describes the
+  // embedded thumbnail. Only the location of a JPEG thumbnail is extracted.
+  if (offs + 4 <= len) {
+    unsigned ifd1_offset = parse_value<uint32_t>(buf + offs, alignIntel);
+    unsigned thumb_offs = tiff_header_start + ifd1_offset;
+    if (ifd1_offset && thumb_offs + 2 <= len) {
+      int num_thumb_entries = parse_value<uint16_t>(buf + thumb_offs, alignIntel);
+      thumb_offs += 2;
+      unsigned thumbnail_start = 0;
+      unsigned thumbnail_length = 0;
+      while (--num_thumb_entries >= 0 && thumb_offs + 12 <= len) {
+        IFEntry result =
+            parseIFEntry(buf, thumb_offs, alignIntel, tiff_header_start, len);
+        thumb_offs += 12;
+        if (result.format() != 4 || result.val_long().empty()) continue;
+        if (result.tag() == 0x201)
+          thumbnail_start = tiff_header_start + result.val_long().front();
+        else if (result.tag() == 0x202)
+          thumbnail_length = result.val_long().front();
+      }
+      if (thumbnail_start && thumbnail_length &&
+          thumbnail_start + thumbnail_length <= len &&
+          thumbnail_start + thumbnail_length > thumbnail_start) {
+        this->ThumbnailOffset = thumbnail_start;
+        this->ThumbnailLength = thumbnail_length;
+      }
+    }
+  }
+
   // Jump to the EXIF SubIFD if it exists and parse all the information
   // there. Note that it's possible that the EXIF SubIFD doesn't exist.
   // The EXIF SubIFD contains most of the interesting information that a
@@ -889,6 +920,8 @@ void easyexif::EXIFInfo::clear() {
   MeteringMode = 0;
   ImageWidth = 0;
   ImageHeight = 0;
+  ThumbnailOffset = 0;
+  ThumbnailLength = 0;
 
   // Geolocation
   GeoLocation.Latitude = 0;
@@ -116,6 +116,9 @@ class EXIFInfo {
                                     // 5: multi-segment
   unsigned ImageWidth;              // Image width reported in EXIF data
   unsigned ImageHeight;             // Image height reported in EXIF data
+  unsigned ThumbnailOffset;         // Offset of the embedded JPEG thumbnail (IFD1) from
+                                    // the start of the parsed buffer, 0 if there is none
+  unsigned ThumbnailLength;         // Length in bytes of the embedded JPEG thumbnail
   struct Geolocation_t {            // GPS information embedded in file
     double Latitude;                  // Image latitude expressed as decimal
     double Longitude;                 // Image longitude expressed as decimal
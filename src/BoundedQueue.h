@@ -0,0 +1,62 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+// Blocking FIFO with a fixed capacity, so that producers cannot run ahead of
+// consumers by more than that many items
+template <typename T>
+class BoundedQueue
+{
+public:
+	explicit BoundedQueue(size_t maxItems) : capacity(maxItems > 0 ? maxItems : 1) {}
+	BoundedQueue(const BoundedQueue&) = delete;
+	BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+	// Block while the queue is full; false if the queue was closed meanwhile
+	bool push(T&& item)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		notFull.wait(lock, [this]() { return items.size() < capacity || isClosed; });
+		if (isClosed)
+			return false;
+
+		items.push_back(std::move(item));
+		notEmpty.notify_one();
+		return true;
+	}
+
+	// Block while the queue is empty; false once it is closed and drained
+	bool pop(T& item)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		notEmpty.wait(lock, [this]() { return !items.empty() || isClosed; });
+		if (items.empty())
+			return false;
+
+		item = std::move(items.front());
+		items.pop_front();
+		notFull.notify_one();
+		return true;
+	}
+
+	// No more items will be pushed, waiting consumers drain what is left
+	void close()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		isClosed = true;
+		notEmpty.notify_all();
+		notFull.notify_all();
+	}
+
+private:
+	const size_t capacity;
+	std::mutex mutex;
+	std::condition_variable notFull;
+	std::condition_variable notEmpty;
+	std::deque<T> items;
+	bool isClosed = false;
+};
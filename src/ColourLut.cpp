@@ -0,0 +1,219 @@
+#include <ColourLut.h>
+
+#include <Parallel.h>
+#include <Pixel.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <system_error>
+#include <utility>
+
+#define COLOUR_LUT_VERSION 3
+
+static const char colourLutMagic[4] = { 'M', 'S', 'X', 'L' };
+
+namespace
+{
+	struct FileHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t resolution;
+		uint32_t numTiles;
+		uint64_t tilesHash;
+		float worstError;
+		uint32_t padding;
+	};
+}
+
+void ColourLut::build(int res, int n, uint64_t hash, int numThreads, const MatchFunction& findNearest,
+	const MatchFunction& findExactNearest, const DistanceFunction& getDistance)
+{
+	assert(res > 0 && res <= 256);
+	assert(n > 0);
+
+	resolution = res;
+	numTiles = n;
+	tilesHash = hash;
+	tileIndices.assign(size_t(resolution) * resolution * resolution, -1);
+
+	// Middle of the 8-bit values falling into each cell along an axis
+	std::vector<int> lowestValues(resolution, 256);
+	std::vector<int> highestValues(resolution, -1);
+	for (int value = 0; value < 256; value++)
+	{
+		const int cellIndex = value * resolution / 256;
+		lowestValues[cellIndex] = std::min(lowestValues[cellIndex], value);
+		highestValues[cellIndex] = std::max(highestValues[cellIndex], value);
+	}
+	std::vector<float> cellCentres(resolution);
+	for (int cellIndex = 0; cellIndex < resolution; cellIndex++)
+		cellCentres[cellIndex] = float(lowestValues[cellIndex] + highestValues[cellIndex]) * 0.5f / 255.0f;
+
+	parallelFor(resolution, numThreads, [&](int r)
+	{
+		Pixel colour;
+		colour.r = cellCentres[r];
+		colour.a = 1.0f;
+		for (int g = 0; g < resolution; g++)
+		{
+			colour.g = cellCentres[g];
+			for (int b = 0; b < resolution; b++)
+			{
+				colour.b = cellCentres[b];
+				tileIndices[(size_t(r) * resolution + g) * resolution + b] = findNearest(colour);
+			}
+		}
+	});
+
+	worstError = 0.0f;
+	if (resolution == 256)
+		return;
+
+	// Colours within a cell share its tile. The error is sampled at the extreme 8-bit colours of each
+	// cell and at its middle, against the exact closest tile rather than the configured search.
+	std::vector<float> worstErrors(resolution, 0.0f);
+	parallelFor(resolution, numThreads, [&](int r)
+	{
+		for (int g = 0; g < resolution; g++)
+		{
+			for (int b = 0; b < resolution; b++)
+			{
+				const int tileIndex = tileIndices[(size_t(r) * resolution + g) * resolution + b];
+				for (int sample = 0; sample < 9; sample++)
+				{
+					Pixel colour;
+					if (sample < 8)
+					{
+						colour.r = float((sample & 1) ? highestValues[r] : lowestValues[r]) / 255.0f;
+						colour.g = float((sample & 2) ? highestValues[g] : lowestValues[g]) / 255.0f;
+						colour.b = float((sample & 4) ? highestValues[b] : lowestValues[b]) / 255.0f;
+					}
+					else
+					{
+						colour.r = cellCentres[r];
+						colour.g = cellCentres[g];
+						colour.b = cellCentres[b];
+					}
+					colour.a = 1.0f;
+
+					const float error = getDistance(colour, tileIndex) - getDistance(colour, findExactNearest(colour));
+					worstErrors[r] = std::max(worstErrors[r], error);
+				}
+			}
+		}
+	});
+	worstError = *std::max_element(worstErrors.begin(), worstErrors.end());
+}
+
+bool ColourLut::load(const std::filesystem::path& path, int res, int n, uint64_t hash)
+{
+	reset();
+
+	std::ifstream file(path, std::ios::in | std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	FileHeader header = {};
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!file ||
+		std::memcmp(header.magic, colourLutMagic, sizeof(colourLutMagic)) != 0 ||
+		header.version != COLOUR_LUT_VERSION ||
+		header.resolution != uint32_t(res) ||
+		header.numTiles != uint32_t(n) ||
+		header.tilesHash != hash)
+		return false;
+
+	std::vector<int32_t> indices(size_t(res) * res * res);
+	file.read(reinterpret_cast<char*>(indices.data()), std::streamsize(indices.size() * sizeof(int32_t)));
+	if (!file)
+		return false;
+
+	for (const int32_t tileIndex : indices)
+	{
+		if (tileIndex < 0 || tileIndex >= n)
+			return false;
+	}
+
+	resolution = res;
+	numTiles = n;
+	tilesHash = hash;
+	worstError = header.worstError;
+	tileIndices = std::move(indices);
+
+	return true;
+}
+
+bool ColourLut::write(const std::filesystem::path& path) const
+{
+	assert(isValid());
+
+	FileHeader header = {};
+	std::memcpy(header.magic, colourLutMagic, sizeof(colourLutMagic));
+	header.version = COLOUR_LUT_VERSION;
+	header.resolution = uint32_t(resolution);
+	header.numTiles = uint32_t(numTiles);
+	header.tilesHash = tilesHash;
+	header.worstError = worstError;
+
+	// Write next to the destination and rename over it once complete
+	std::filesystem::path tempPath(path);
+	tempPath += ".tmp";
+
+	std::ofstream file(tempPath, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+	{
+		std::cerr << "Could not open file " << tempPath.native() << " for writing." << std::endl;
+		return false;
+	}
+
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(tileIndices.data()), std::streamsize(tileIndices.size() * sizeof(int32_t)));
+	file.close();
+
+	std::error_code error;
+	if (file)
+		std::filesystem::rename(tempPath, path, error);
+	if (!file || error)
+	{
+		std::cerr << "Could not write colour lookup table '" << path.native() << "'." << std::endl;
+		std::filesystem::remove(tempPath, error);
+		return false;
+	}
+
+	std::cout << "Successfully wrote colour lookup table '" << path.native() << "'." << std::endl;
+
+	return true;
+}
+
+void ColourLut::reset()
+{
+	resolution = 0;
+	numTiles = 0;
+	tilesHash = 0;
+	worstError = 0.0f;
+	tileIndices.clear();
+}
+
+bool ColourLut::isValid() const
+{
+	return resolution > 0 && !tileIndices.empty();
+}
+
+int ColourLut::lookup(const Pixel& colour) const
+{
+	assert(isValid());
+
+	const size_t cellIndex = (size_t(getCellIndex(colour.r)) * resolution + getCellIndex(colour.g)) * resolution +
+		getCellIndex(colour.b);
+	return tileIndices[cellIndex];
+}
+
+int ColourLut::getCellIndex(float value) const
+{
+	const int value8 = std::min(std::max(int(value * 255.0f + 0.5f), 0), 255);
+	return value8 * resolution / 256;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <vector>
+
+struct Pixel;
+
+// Nearest tile for every cell of a regular RGB grid, so that matching an opaque colour
+// takes a single lookup. Each cell holds the match of the middle of the 8-bit colours
+// that fall into it; at a resolution of 256 every 8-bit colour has a cell of its own
+// and lookups are exact.
+class ColourLut
+{
+public:
+	using MatchFunction = std::function<int(const Pixel& colour)>;
+	using DistanceFunction = std::function<float(const Pixel& colour, int tileIndex)>;
+
+	// tilesHash identifies the tile features and the search the table was built from.
+	// findExactNearest and getDistance measure the error of the table: at the corners and
+	// the middle of every cell, how much farther its tile is than the truly closest one.
+	void build(int resolution, int numTiles, uint64_t tilesHash, int numThreads, const MatchFunction& findNearest,
+		const MatchFunction& findExactNearest, const DistanceFunction& getDistance);
+	// Fails unless the file was built with the same resolution from the same tiles
+	bool load(const std::filesystem::path& path, int resolution, int numTiles, uint64_t tilesHash);
+	bool write(const std::filesystem::path& path) const;
+	void reset();
+	bool isValid() const;
+	int getResolution() const { return resolution; }
+	// Largest distance increase over the exact search found at the sampled colours, a lower
+	// bound on the error within the cells; zero when every colour has its own cell
+	float getWorstError() const { return worstError; }
+	int lookup(const Pixel& colour) const;
+
+private:
+	int resolution = 0;
+	int numTiles = 0;
+	uint64_t tilesHash = 0;
+	float worstError = 0.0f;
+	// Cell (r, g, b) lives at (r * resolution + g) * resolution + b
+	std::vector<int32_t> tileIndices;
+
+	int getCellIndex(float value) const;
+};
@@ -0,0 +1,55 @@
+#include <ColourSpace.h>
+
+#include <Pixel.h>
+
+#include <cmath>
+
+namespace
+{
+	float toLinear(float value)
+	{
+		return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+	}
+
+	// From https://bottosson.github.io/posts/oklab/
+	void linearRgbToOklab(float r, float g, float b, float& okL, float& okA, float& okB)
+	{
+		const float l = std::cbrt(0.4122214708f * r + 0.5363325363f * g + 0.0514459929f * b);
+		const float m = std::cbrt(0.2119034982f * r + 0.6806995451f * g + 0.1073969566f * b);
+		const float s = std::cbrt(0.0883024619f * r + 0.2817188376f * g + 0.6299787005f * b);
+
+		okL = 0.2104542553f * l + 0.7936177850f * m - 0.0040720468f * s;
+		okA = 1.9779984951f * l - 2.4285922050f * m + 0.4505937099f * s;
+		okB = 0.0259040371f * l + 0.7827717662f * m - 0.8086757660f * s;
+	}
+}
+
+void computeColourFeatures(ColourSpace space, const Pixel& colour, float* features, bool withAlpha)
+{
+	switch (space)
+	{
+	case ColourSpace::Rgb:
+		features[0] = colour.r;
+		features[1] = colour.g;
+		features[2] = colour.b;
+		break;
+	case ColourSpace::Oklab:
+		linearRgbToOklab(toLinear(colour.r), toLinear(colour.g), toLinear(colour.b), features[0], features[1], features[2]);
+		break;
+	}
+
+	// Lightness and alpha both range over [0, 1] and weigh the same
+	if (withAlpha)
+		features[3] = colour.a;
+}
+
+bool parseColourSpace(const std::string& name, ColourSpace& space)
+{
+	if (name == "rgb")
+		space = ColourSpace::Rgb;
+	else if (name == "oklab")
+		space = ColourSpace::Oklab;
+	else
+		return false;
+	return true;
+}
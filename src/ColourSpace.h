@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+
+struct Pixel;
+
+// Space in which colours are compared when matching tiles
+enum class ColourSpace
+{
+	// Gamma-encoded RGB as stored in images
+	Rgb,
+	// Perceptually uniform, Euclidean distances follow perceived differences
+	Oklab,
+};
+
+// Number of floats written by computeColourFeatures, one less without alpha
+#define COLOUR_FEATURE_DIMENSION 4
+
+// Express a colour in the given space, followed by its alpha unless withAlpha is false
+void computeColourFeatures(ColourSpace space, const Pixel& colour, float* features, bool withAlpha = true);
+bool parseColourSpace(const std::string& name, ColourSpace& space);
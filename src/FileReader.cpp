@@ -0,0 +1,469 @@
+#include <FileReader.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+namespace
+{
+	void reportReadError(const std::filesystem::path& path)
+	{
+		std::ostringstream message;
+		message << "Could not read file '" << path.native() << "'." << std::endl;
+		std::cerr << message.str();
+	}
+}
+
+#ifdef __linux__
+// Minimal io_uring driven through raw system calls, so that no library is needed
+struct FileReader::IoUring
+{
+	int fd = -1;
+	unsigned numSubmissionEntries = 0;
+	unsigned numPendingSubmissions = 0;
+
+	void* submissionRing = nullptr;
+	size_t submissionRingSize = 0;
+	unsigned* submissionHead = nullptr;
+	unsigned* submissionTail = nullptr;
+	unsigned* submissionRingMask = nullptr;
+	unsigned* submissionArray = nullptr;
+	io_uring_sqe* submissionEntries = nullptr;
+	size_t submissionEntriesSize = 0;
+
+	void* completionRing = nullptr;
+	size_t completionRingSize = 0;
+	unsigned* completionHead = nullptr;
+	unsigned* completionTail = nullptr;
+	unsigned* completionRingMask = nullptr;
+	io_uring_cqe* completionEntries = nullptr;
+
+	~IoUring()
+	{
+		if (submissionEntries)
+			munmap(submissionEntries, submissionEntriesSize);
+		if (completionRing && completionRing != submissionRing)
+			munmap(completionRing, completionRingSize);
+		if (submissionRing)
+			munmap(submissionRing, submissionRingSize);
+		if (fd >= 0)
+			close(fd);
+	}
+
+	bool init(unsigned numEntries)
+	{
+		io_uring_params params = {};
+		fd = int(syscall(__NR_io_uring_setup, numEntries, &params));
+		if (fd < 0)
+			return false;
+
+		numSubmissionEntries = params.sq_entries;
+		submissionRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		completionRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+		// Recent kernels map both rings at once
+		const bool isSingleMapping = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+		if (isSingleMapping)
+		{
+			submissionRingSize = std::max(submissionRingSize, completionRingSize);
+			completionRingSize = submissionRingSize;
+		}
+
+		void* address = mmap(nullptr, submissionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+		if (address == MAP_FAILED)
+			return false;
+		submissionRing = address;
+
+		if (isSingleMapping)
+		{
+			completionRing = submissionRing;
+		}
+		else
+		{
+			address = mmap(nullptr, completionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+			if (address == MAP_FAILED)
+				return false;
+			completionRing = address;
+		}
+
+		submissionEntriesSize = params.sq_entries * sizeof(io_uring_sqe);
+		address = mmap(nullptr, submissionEntriesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+		if (address == MAP_FAILED)
+			return false;
+		submissionEntries = static_cast<io_uring_sqe*>(address);
+
+		unsigned char* submissionBase = static_cast<unsigned char*>(submissionRing);
+		submissionHead = reinterpret_cast<unsigned*>(submissionBase + params.sq_off.head);
+		submissionTail = reinterpret_cast<unsigned*>(submissionBase + params.sq_off.tail);
+		submissionRingMask = reinterpret_cast<unsigned*>(submissionBase + params.sq_off.ring_mask);
+		submissionArray = reinterpret_cast<unsigned*>(submissionBase + params.sq_off.array);
+
+		unsigned char* completionBase = static_cast<unsigned char*>(completionRing);
+		completionHead = reinterpret_cast<unsigned*>(completionBase + params.cq_off.head);
+		completionTail = reinterpret_cast<unsigned*>(completionBase + params.cq_off.tail);
+		completionRingMask = reinterpret_cast<unsigned*>(completionBase + params.cq_off.ring_mask);
+		completionEntries = reinterpret_cast<io_uring_cqe*>(completionBase + params.cq_off.cqes);
+
+		return supportsOperations();
+	}
+
+	// Opening, reading and closing through the ring need Linux 5.6 or later
+	bool supportsOperations() const
+	{
+		const size_t probeSize = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+		std::vector<unsigned char> probeBuffer(probeSize, 0);
+		io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(probeBuffer.data());
+		if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) < 0)
+			return false;
+
+		for (const int operation : { IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_CLOSE })
+		{
+			if (operation > probe->last_op || !(probe->ops[operation].flags & IO_URING_OP_SUPPORTED))
+				return false;
+		}
+		return true;
+	}
+
+	// Next free submission entry, cleared; it is submitted by the next submitAndWait
+	io_uring_sqe* getSubmissionEntry()
+	{
+		const unsigned tail = *submissionTail;
+		const unsigned head = __atomic_load_n(submissionHead, __ATOMIC_ACQUIRE);
+		if (tail - head >= numSubmissionEntries)
+			return nullptr;
+
+		const unsigned index = tail & *submissionRingMask;
+		io_uring_sqe* entry = &submissionEntries[index];
+		std::memset(entry, 0, sizeof(io_uring_sqe));
+		submissionArray[index] = index;
+		__atomic_store_n(submissionTail, tail + 1, __ATOMIC_RELEASE);
+		numPendingSubmissions++;
+
+		return entry;
+	}
+
+	// Take back the entries the kernel has not consumed yet, calling onEntry for each
+	template <typename EntryCallback>
+	void discardUnsubmitted(const EntryCallback& onEntry)
+	{
+		const unsigned head = __atomic_load_n(submissionHead, __ATOMIC_ACQUIRE);
+		for (unsigned index = head; index != *submissionTail; index++)
+			onEntry(submissionEntries[submissionArray[index & *submissionRingMask]]);
+		__atomic_store_n(submissionTail, head, __ATOMIC_RELEASE);
+		numPendingSubmissions = 0;
+	}
+
+	bool submitAndWait(unsigned minCompletions)
+	{
+		for (;;)
+		{
+			const long result = syscall(__NR_io_uring_enter, fd, numPendingSubmissions, minCompletions,
+				IORING_ENTER_GETEVENTS, nullptr, 0);
+			if (result >= 0)
+			{
+				numPendingSubmissions -= unsigned(result);
+				return true;
+			}
+			if (errno != EINTR)
+				return false;
+		}
+	}
+};
+#else
+struct FileReader::IoUring
+{
+};
+#endif
+
+FileReader::~FileReader()
+{
+	delete ring;
+}
+
+bool FileReader::initIoUring(int queueDepth)
+{
+	assert(queueDepth > 0);
+
+	delete ring;
+	ring = nullptr;
+
+#ifdef __linux__
+	ring = new IoUring();
+	if (!ring->init(unsigned(queueDepth)))
+	{
+		delete ring;
+		ring = nullptr;
+	}
+#endif
+
+	return ring != nullptr;
+}
+
+bool FileReader::isUsingIoUring() const
+{
+	return ring != nullptr;
+}
+
+void FileReader::readFiles(const std::vector<TileSourceFile>& sourceFiles, const std::vector<int>& fileIndices,
+	const FileReadCallback& onFileRead)
+{
+	if (ring)
+	{
+		readFilesWithIoUring(sourceFiles, fileIndices, onFileRead);
+		return;
+	}
+
+	std::vector<unsigned char> bytes;
+	for (const int fileIndex : fileIndices)
+	{
+		if (readFile(sourceFiles[fileIndex].path, bytes))
+			onFileRead(fileIndex, bytes);
+		else
+			reportReadError(sourceFiles[fileIndex].path);
+	}
+}
+
+bool FileReader::readFile(const std::filesystem::path& path, std::vector<unsigned char>& bytes)
+{
+	const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+
+	struct stat fileStat;
+	if (fstat(fd, &fileStat) != 0)
+	{
+		close(fd);
+		return false;
+	}
+
+	bytes.resize(size_t(fileStat.st_size));
+	size_t numBytesRead = 0;
+	while (numBytesRead < bytes.size())
+	{
+		const ssize_t result = pread(fd, bytes.data() + numBytesRead, bytes.size() - numBytesRead, off_t(numBytesRead));
+		if (result <= 0)
+			break;
+		numBytesRead += size_t(result);
+	}
+	close(fd);
+
+	bytes.resize(numBytesRead);
+	return numBytesRead > 0;
+}
+
+void FileReader::readFilesWithIoUring(const std::vector<TileSourceFile>& sourceFiles, const std::vector<int>& fileIndices,
+	const FileReadCallback& onFileRead)
+{
+#ifdef __linux__
+	enum Operation : uint64_t { Open = 0, Read = 1, Close = 2 };
+
+	// Each slot holds one file from open to close and has at most one operation
+	// in flight, so the rings can never overflow
+	struct Request
+	{
+		int fileIndex = -1;
+		int fd = -1;
+		std::vector<unsigned char> bytes;
+		size_t numBytesRead = 0;
+		// Not handed to onFileRead yet
+		bool isPending = false;
+		bool isInFlight = false;
+		bool isCloseQueued = false;
+	};
+
+	const int numSlots = int(ring->numSubmissionEntries);
+	std::vector<Request> requests(numSlots);
+	std::vector<int> freeSlots;
+	for (int slot = numSlots - 1; slot >= 0; slot--)
+		freeSlots.push_back(slot);
+
+	auto submit = [&](Operation operation, int slot) -> io_uring_sqe*
+	{
+		io_uring_sqe* entry = ring->getSubmissionEntry();
+		assert(entry != nullptr);
+		entry->opcode = operation == Open ? IORING_OP_OPENAT : operation == Read ? IORING_OP_READ : IORING_OP_CLOSE;
+		entry->user_data = uint64_t(slot) * 4 + operation;
+		requests[slot].isInFlight = true;
+		return entry;
+	};
+	auto submitRead = [&](int slot)
+	{
+		Request& request = requests[slot];
+		io_uring_sqe* entry = submit(Read, slot);
+		entry->fd = request.fd;
+		entry->addr = reinterpret_cast<uint64_t>(request.bytes.data() + request.numBytesRead);
+		entry->len = unsigned(request.bytes.size() - request.numBytesRead);
+		entry->off = request.numBytesRead;
+	};
+	auto submitClose = [&](int slot)
+	{
+		io_uring_sqe* entry = submit(Close, slot);
+		entry->fd = requests[slot].fd;
+		requests[slot].isCloseQueued = true;
+	};
+
+	// While draining, completions are only recorded: no operation is queued and
+	// unfinished files are left pending
+	auto reapCompletions = [&](bool isDraining)
+	{
+		unsigned head = *ring->completionHead;
+		const unsigned tail = __atomic_load_n(ring->completionTail, __ATOMIC_ACQUIRE);
+		for (; head != tail; head++)
+		{
+			const io_uring_cqe& completion = ring->completionEntries[head & *ring->completionRingMask];
+			const int slot = int(completion.user_data / 4);
+			const Operation operation = Operation(completion.user_data % 4);
+			Request& request = requests[slot];
+			const TileSourceFile& sourceFile = sourceFiles[request.fileIndex];
+			request.isInFlight = false;
+
+			if (operation == Close)
+			{
+				// The descriptor is released even when close reports an error
+				request.fd = -1;
+				request.isCloseQueued = false;
+				freeSlots.push_back(slot);
+			}
+			else if (isDraining)
+			{
+				if (operation == Open && completion.res >= 0)
+					request.fd = completion.res;
+			}
+			else if (operation == Open)
+			{
+				if (completion.res < 0)
+				{
+					reportReadError(sourceFile.path);
+					request.isPending = false;
+					freeSlots.push_back(slot);
+					continue;
+				}
+
+				// The size from the folder listing saves a stat call per file
+				request.fd = completion.res;
+				request.bytes.resize(size_t(sourceFile.size));
+				if (request.bytes.empty())
+				{
+					reportReadError(sourceFile.path);
+					request.isPending = false;
+					submitClose(slot);
+				}
+				else
+				{
+					submitRead(slot);
+				}
+			}
+			else
+			{
+				if (completion.res > 0)
+				{
+					request.numBytesRead += size_t(completion.res);
+					if (request.numBytesRead < request.bytes.size())
+					{
+						submitRead(slot);
+						continue;
+					}
+				}
+
+				request.bytes.resize(request.numBytesRead);
+				if (completion.res >= 0 && !request.bytes.empty())
+					onFileRead(request.fileIndex, request.bytes);
+				else
+					reportReadError(sourceFile.path);
+				request.isPending = false;
+				request.bytes = std::vector<unsigned char>();
+				submitClose(slot);
+			}
+		}
+		__atomic_store_n(ring->completionHead, head, __ATOMIC_RELEASE);
+	};
+
+	size_t nextTaskIndex = 0;
+	while (nextTaskIndex < fileIndices.size() || int(freeSlots.size()) < numSlots)
+	{
+		while (nextTaskIndex < fileIndices.size() && !freeSlots.empty())
+		{
+			const int slot = freeSlots.back();
+			freeSlots.pop_back();
+
+			Request& request = requests[slot];
+			request.fileIndex = fileIndices[nextTaskIndex++];
+			request.fd = -1;
+			request.numBytesRead = 0;
+			request.isPending = true;
+
+			io_uring_sqe* entry = submit(Open, slot);
+			entry->fd = AT_FDCWD;
+			entry->addr = reinterpret_cast<uint64_t>(sourceFiles[request.fileIndex].path.c_str());
+			entry->open_flags = O_RDONLY | O_CLOEXEC;
+		}
+
+		if (!ring->submitAndWait(1))
+		{
+			std::cerr << "io_uring failed with error " << errno << ", reading remaining files with pread." << std::endl;
+			break;
+		}
+
+		reapCompletions(false);
+	}
+
+	if (nextTaskIndex == fileIndices.size() && int(freeSlots.size()) == numSlots)
+		return;
+
+	// The ring failed. Operations the kernel has not seen are taken back, and the others
+	// are waited for, so that no buffer is freed and no descriptor lost while in flight.
+	ring->discardUnsubmitted([&](const io_uring_sqe& entry)
+	{
+		Request& request = requests[entry.user_data / 4];
+		request.isInFlight = false;
+		if (entry.user_data % 4 == Close)
+			request.isCloseQueued = false;
+	});
+
+	bool isDrained = true;
+	while (isDrained && std::any_of(requests.begin(), requests.end(), [](const Request& request) { return request.isInFlight; }))
+	{
+		isDrained = ring->submitAndWait(1);
+		if (isDrained)
+			reapCompletions(true);
+	}
+
+	const std::vector<Request>* remainingRequests = &requests;
+	if (isDrained)
+	{
+		delete ring;
+	}
+	else
+	{
+		// The kernel may still write to the buffers, so they are leaked along with the ring
+		std::cerr << "io_uring could not be drained, leaking its buffers." << std::endl;
+		remainingRequests = new std::vector<Request>(std::move(requests));
+	}
+	ring = nullptr;
+
+	std::vector<int> remainingFileIndices;
+	for (const Request& request : *remainingRequests)
+	{
+		if (request.fd >= 0 && !request.isCloseQueued)
+			close(request.fd);
+		if (request.isPending)
+			remainingFileIndices.push_back(request.fileIndex);
+	}
+	remainingFileIndices.insert(remainingFileIndices.end(), fileIndices.begin() + nextTaskIndex, fileIndices.end());
+	readFiles(sourceFiles, remainingFileIndices, onFileRead);
+#endif
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <TileCache.h>
+
+#include <functional>
+#include <vector>
+
+// Reads whole files into memory. When the kernel allows it, an io_uring keeps many
+// opens, reads and closes in flight from a single thread; otherwise files are read
+// one at a time with pread.
+class FileReader
+{
+public:
+	using FileReadCallback = std::function<void(int fileIndex, std::vector<unsigned char>& bytes)>;
+
+	FileReader() = default;
+	FileReader(const FileReader&) = delete;
+	virtual ~FileReader();
+
+	FileReader& operator=(const FileReader&) = delete;
+
+	// Set up a ring with up to queueDepth files in flight; false if io_uring is unavailable
+	bool initIoUring(int queueDepth);
+	bool isUsingIoUring() const;
+	// Read sourceFiles[i] for every i in fileIndices, calling onFileRead in completion
+	// order. Files that cannot be read are skipped with a message.
+	void readFiles(const std::vector<TileSourceFile>& sourceFiles, const std::vector<int>& fileIndices,
+		const FileReadCallback& onFileRead);
+
+	static bool readFile(const std::filesystem::path& path, std::vector<unsigned char>& bytes);
+
+private:
+	struct IoUring;
+
+	IoUring* ring = nullptr;
+
+	void readFilesWithIoUring(const std::vector<TileSourceFile>& sourceFiles, const std::vector<int>& fileIndices,
+		const FileReadCallback& onFileRead);
+};
@@ -1,5 +1,6 @@
 #include <Image.h>
 
+#include <MappedFile.h>
 #include <Pixel.h>
 
 #include <exif.h>
@@ -10,17 +11,187 @@
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <stb_image_write.h>
 
+#ifdef MOSAIX_HAS_LIBJPEG
+#include <csetjmp>
+#include <cstdio>
+#include <jpeglib.h>
+#endif
+
+#include <algorithm>
 #include <cassert>
-#include <fstream>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <sstream>
+#include <utility>
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#define MOSAIX_HAS_SSE2
+#include <emmintrin.h>
+#endif
 
 #define MAX_CHANNELS 4
 // Max to avoid overflow with 4 channels
 #define MAX_SIDE_LENGTH 16384
+// 16-bit lanes summing two bytes per chunk are widened before they can overflow
+#define SUM_CHUNKS_PER_FLUSH 128
+
+namespace
+{
+	// Adds the channels of a w x h block of pixels to sums. Rows fit in 32 bits since sides
+	// are shorter than MAX_SIDE_LENGTH.
+	template <int Channels>
+	void sumBlockScalar(const unsigned char* first, size_t rowSize, int w, int h, uint64_t* sums)
+	{
+		for (int y = 0; y < h; y++)
+		{
+			const unsigned char* pixel = first + y * rowSize;
+			const unsigned char* rowEnd = pixel + size_t(w) * Channels;
+			uint32_t rowSums[Channels] = {};
+			for (; pixel != rowEnd; pixel += Channels)
+			{
+				for (int channel = 0; channel < Channels; channel++)
+					rowSums[channel] += pixel[channel];
+			}
+			for (int channel = 0; channel < Channels; channel++)
+				sums[channel] += rowSums[channel];
+		}
+	}
+
+	template <int Channels>
+	void sumBlock(const unsigned char* first, size_t rowSize, int w, int h, uint64_t* sums)
+	{
+		sumBlockScalar<Channels>(first, rowSize, w, h, sums);
+	}
+
+#ifdef MOSAIX_HAS_SSE2
+	template <>
+	void sumBlock<1>(const unsigned char* first, size_t rowSize, int w, int h, uint64_t* sums)
+	{
+		// Sums of absolute differences with zero add up 8 bytes into each 64-bit half
+		const __m128i zero = _mm_setzero_si128();
+		__m128i total = zero;
+		const int vectorWidth = w & ~15;
+		for (int y = 0; y < h; y++)
+		{
+			const unsigned char* row = first + y * rowSize;
+			for (int x = 0; x < vectorWidth; x += 16)
+			{
+				const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x));
+				total = _mm_add_epi64(total, _mm_sad_epu8(bytes, zero));
+			}
+		}
+		uint64_t halves[2];
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(halves), total);
+		sums[0] += halves[0] + halves[1];
+
+		if (vectorWidth < w)
+			sumBlockScalar<1>(first + vectorWidth, rowSize, w - vectorWidth, h, sums);
+	}
+
+	template <>
+	void sumBlock<3>(const unsigned char* first, size_t rowSize, int w, int h, uint64_t* sums)
+	{
+		// 16 pixels are 48 bytes, widened to six vectors of eight 16-bit lanes. Vectors three
+		// apart hold the same channels in the same lanes, so three accumulators are enough.
+		const __m128i zero = _mm_setzero_si128();
+		const int vectorWidth = w & ~15;
+		uint64_t laneSums[3][8] = {};
+		for (int y = 0; y < h; y++)
+		{
+			const unsigned char* row = first + y * rowSize;
+			int x = 0;
+			while (x < vectorWidth)
+			{
+				__m128i accumulators[3] = { zero, zero, zero };
+				const int endX = std::min(vectorWidth, x + 16 * SUM_CHUNKS_PER_FLUSH);
+				for (; x < endX; x += 16)
+				{
+					const unsigned char* chunk = row + x * 3;
+					const __m128i bytes0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(chunk));
+					const __m128i bytes1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(chunk + 16));
+					const __m128i bytes2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(chunk + 32));
+					accumulators[0] = _mm_add_epi16(accumulators[0],
+						_mm_add_epi16(_mm_unpacklo_epi8(bytes0, zero), _mm_unpackhi_epi8(bytes1, zero)));
+					accumulators[1] = _mm_add_epi16(accumulators[1],
+						_mm_add_epi16(_mm_unpackhi_epi8(bytes0, zero), _mm_unpacklo_epi8(bytes2, zero)));
+					accumulators[2] = _mm_add_epi16(accumulators[2],
+						_mm_add_epi16(_mm_unpacklo_epi8(bytes1, zero), _mm_unpackhi_epi8(bytes2, zero)));
+				}
+				for (int pattern = 0; pattern < 3; pattern++)
+				{
+					uint16_t lanes[8];
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), accumulators[pattern]);
+					for (int lane = 0; lane < 8; lane++)
+						laneSums[pattern][lane] += lanes[lane];
+				}
+			}
+		}
+
+		// Lane j of pattern p holds byte 8 * p + j of every 24, modulo 3 its channel
+		for (int pattern = 0; pattern < 3; pattern++)
+		{
+			for (int lane = 0; lane < 8; lane++)
+				sums[(8 * pattern + lane) % 3] += laneSums[pattern][lane];
+		}
+
+		if (vectorWidth < w)
+			sumBlockScalar<3>(first + vectorWidth * 3, rowSize, w - vectorWidth, h, sums);
+	}
+
+	template <>
+	void sumBlock<4>(const unsigned char* first, size_t rowSize, int w, int h, uint64_t* sums)
+	{
+		// Four pixels per vector; after widening, the two halves of each 16-bit vector
+		// hold two pixels, and the 32-bit accumulator one sum per channel
+		const __m128i zero = _mm_setzero_si128();
+		const int vectorWidth = w & ~3;
+		for (int y = 0; y < h; y++)
+		{
+			const unsigned char* row = first + y * rowSize;
+			__m128i accumulator = zero;
+			for (int x = 0; x < vectorWidth; x += 4)
+			{
+				const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x * 4));
+				const __m128i pairs = _mm_add_epi16(_mm_unpacklo_epi8(bytes, zero), _mm_unpackhi_epi8(bytes, zero));
+				accumulator = _mm_add_epi32(accumulator, _mm_unpacklo_epi16(pairs, zero));
+				accumulator = _mm_add_epi32(accumulator, _mm_unpackhi_epi16(pairs, zero));
+			}
+			uint32_t rowSums[4];
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(rowSums), accumulator);
+			for (int channel = 0; channel < 4; channel++)
+				sums[channel] += rowSums[channel];
+		}
+
+		if (vectorWidth < w)
+			sumBlockScalar<4>(first + vectorWidth * 4, rowSize, w - vectorWidth, h, sums);
+	}
+#endif
+}
+
+Image::Image(Image&& other)
+{
+	*this = std::move(other);
+}
 
 Image::~Image()
 {
-	delete data;
+	free(data);
+}
+
+Image& Image::operator=(Image&& other)
+{
+	if (this != &other)
+	{
+		reset();
+		std::swap(width, other.width);
+		std::swap(height, other.height);
+		std::swap(channels, other.channels);
+		std::swap(orientation, other.orientation);
+		std::swap(data, other.data);
+	}
+	return *this;
 }
 
 void Image::init(int w, int h, int nChannels)
@@ -38,8 +209,10 @@ void Image::init(int w, int h, int nChannels)
 	width = w;
 	height = h;
 	channels = nChannels;
+	orientation = 1;
 	const int dataSize = sizeInBytes();
-	data = new unsigned char[dataSize];
+	// Pixels are allocated with malloc to match the buffers handed over by decoders
+	data = static_cast<unsigned char*>(malloc(dataSize));
 }
 
 void Image::reset()
@@ -47,7 +220,8 @@ void Image::reset()
 	width = 0;
 	height = 0;
 	channels = 0;
-	delete data;
+	orientation = 1;
+	free(data);
 	data = nullptr;
 }
 
@@ -58,35 +232,77 @@ bool Image::isValid() const
 		height > 0 &&
 		height < MAX_SIDE_LENGTH &&
 		channels > 0 &&
-		channels < MAX_CHANNELS &&
+		channels <= MAX_CHANNELS &&
 		data != nullptr;
 }
 
-bool Image::load(const char* filename)
+bool Image::load(const char* filename, int minSideLength, bool allowExifThumbnail, bool keepStoredOrientation)
+{
+	// Headers and pixels are all read from a single mapping of the file
+	MappedFile file;
+	if (!file.open(filename))
+	{
+		if (data)
+			reset();
+		std::cerr << "Could not load image '" << filename << "'." << std::endl;
+		return false;
+	}
+
+	return loadFromMemory(file.getData(), file.getSize(), filename, minSideLength, allowExifThumbnail,
+		keepStoredOrientation);
+}
+
+bool Image::loadFromMemory(const unsigned char* buffer, size_t size, const char* name,
+	int minSideLength, bool allowExifThumbnail, bool keepStoredOrientation)
 {
 	if (data)
 		reset();
 
-	data = stbi_load(filename, &width, &height, &channels, 0);
+	ImageMetadata metadata;
+	probeMetadata(buffer, size, metadata);
+
+	bool isExifThumbnail = false;
+	if (minSideLength > 0 && allowExifThumbnail && metadata.thumbnailLength > 0)
+		isExifThumbnail = loadExifThumbnail(buffer, metadata, minSideLength);
+
+	int scaleDenominator = 1;
+	if (!isExifThumbnail &&
+		(minSideLength <= 0 || !metadata.isJpeg || !loadScaledJpeg(buffer, size, minSideLength, scaleDenominator)))
+	{
+		data = stbi_load_from_memory(buffer, int(size), &width, &height, &channels, 0);
+	}
 
 	if (data == nullptr)
 	{
-		std::cerr << "Could not load image '" << filename << "'." << std::endl;
+		std::cerr << "Could not load image '" << name << "'." << std::endl;
 		return false;
 	}
 
-	// Rotate data to get proper orientation
-	const int orientation = getOrientationFromExif(filename);
-	const int rotation = getRotationFromOrientation(orientation);
-	rotate(rotation);
+	// Unspecified and invalid orientations are taken as upright
+	orientation = metadata.orientation >= 1 && metadata.orientation <= 8 ? metadata.orientation : 1;
+	const int storedOrientation = orientation;
+	if (!keepStoredOrientation)
+		applyOrientation();
 
-	std::cout << "Successfully loaded image '" << filename <<
+	// Build the message first so that concurrent loads do not interleave their output
+	std::ostringstream message;
+	message << "Successfully loaded image '" << name <<
 		"' with size " << width << "x" << height <<
 		" and " << channels << " channels." << std::endl;
-	if (rotation)
+	if (isExifThumbnail)
+	{
+		message << "Decoded from EXIF thumbnail." << std::endl;
+	}
+	if (scaleDenominator > 1)
+	{
+		message << "Decoded at 1/" << scaleDenominator << " scale." << std::endl;
+	}
+	if (storedOrientation != 1)
 	{
-		std::cout << "Rotated by " << (rotation * 90) << " degrees." << std::endl;
+		message << (keepStoredOrientation ? "Stored" : "Reoriented from") <<
+			" EXIF orientation " << storedOrientation << "." << std::endl;
 	}
+	std::cout << message.str();
 
 	return true;
 }
@@ -111,46 +327,97 @@ void Image::computeTileMean(Pixel& meanPixel, int tileStartX, int tileStartY, in
 
 void Image::computeTileMean(float& meanR, float& meanG, float& meanB, float& meanA, int tileStartX, int tileStartY, int tileSize) const
 {
-	int numSamples = 0;
-	meanR = 0.0f;
-	meanG = 0.0f;
-	meanB = 0.0f;
-	meanA = 0.0f;
+	computeRectMean(meanR, meanG, meanB, meanA, tileStartX, tileStartY, tileSize, tileSize);
+}
 
-	for (int indexInTile = 0; indexInTile < tileSize * tileSize; indexInTile++)
-	{
-		const int y = tileStartY + indexInTile / tileSize;
-		const int x = tileStartX + indexInTile % tileSize;
+int Image::computeRectMean(float& meanR, float& meanG, float& meanB, float& meanA, int startX, int startY, int w, int h) const
+{
+	assert(startX >= 0 && startY >= 0);
 
-		if (x < width && y < height)
-		{
-			float r, g, b, a;
-			readPixel(r, g, b, a, x, y);
-			meanR += r;
-			meanG += g;
-			meanB += b;
-			meanA += a;
-
-			numSamples++;
-		}
+	// Clip once, then walk whole rows
+	const int endX = std::min(startX + w, width);
+	const int endY = std::min(startY + h, height);
+	if (endX <= startX || endY <= startY)
+	{
+		meanR = 0.0f;
+		meanG = 0.0f;
+		meanB = 0.0f;
+		meanA = 0.0f;
+		return 0;
 	}
 
-	if (numSamples)
+	const int clippedWidth = endX - startX;
+	const int clippedHeight = endY - startY;
+	const size_t rowSize = size_t(width) * channels;
+	const unsigned char* first = data + size_t(startY) * rowSize + size_t(startX) * channels;
+	uint64_t sums[MAX_CHANNELS] = {};
+	switch (channels)
 	{
-		const float normalizationFactor = 1.0f / float(numSamples);
-		meanR *= normalizationFactor;
-		meanG *= normalizationFactor;
-		meanB *= normalizationFactor;
-		meanA *= normalizationFactor;
+	case 1:
+		sumBlock<1>(first, rowSize, clippedWidth, clippedHeight, sums);
+		break;
+	case 2:
+		sumBlock<2>(first, rowSize, clippedWidth, clippedHeight, sums);
+		break;
+	case 3:
+		sumBlock<3>(first, rowSize, clippedWidth, clippedHeight, sums);
+		break;
+	default:
+		sumBlock<4>(first, rowSize, clippedWidth, clippedHeight, sums);
+		break;
 	}
+
+	const int numSamples = clippedWidth * clippedHeight;
+	computeMeanFromSums(sums, channels, numSamples, meanR, meanG, meanB, meanA);
+	return numSamples;
+}
+
+void Image::computeMeanFromSums(const uint64_t* sums, int nChannels, int numSamples,
+	float& meanR, float& meanG, float& meanB, float& meanA)
+{
+	assert(nChannels > 0 && nChannels <= MAX_CHANNELS);
+	assert(numSamples > 0);
+
+	const double normalizationFactor = 1.0 / (255.0 * numSamples);
+	float means[MAX_CHANNELS] = {};
+	for (int channel = 0; channel < nChannels; channel++)
+		means[channel] = float(double(sums[channel]) * normalizationFactor);
+
+	// Missing channels are filled in: grey is replicated and alpha defaults to opaque
+	meanR = means[0];
+	meanG = nChannels > 2 ? means[1] : meanR;
+	meanB = nChannels > 2 ? means[2] : meanR;
+	meanA = 1.0f;
+	if (nChannels == 2)
+		meanA = means[1];
+	else if (nChannels > 3)
+		meanA = means[3];
 }
 
 void Image::computeTileMeans(Image& tileMeans, int tileSize) const
 {
+	computeGridMeans(tileMeans, tileSize, 1);
+}
+
+void Image::computeGridMeans(Image& gridMeans, int tileSize, int gridSize) const
+{
+	fillGridMeans(gridMeans, width, height, channels, tileSize, gridSize,
+		[this](float& meanR, float& meanG, float& meanB, float& meanA, int startX, int startY, int w, int h)
+		{
+			return computeRectMean(meanR, meanG, meanB, meanA, startX, startY, w, h);
+		});
+}
+
+void Image::fillGridMeans(Image& gridMeans, int width, int height, int channels, int tileSize, int gridSize,
+	const RectMeanFunction& computeRectMean)
+{
+	assert(tileSize > 0);
+	assert(gridSize > 0);
+
 	const int numTilesX = (width + tileSize - 1) / tileSize;
 	const int numTilesY = (height + tileSize - 1) / tileSize;
 
-	tileMeans.init(numTilesX, numTilesY, channels);
+	gridMeans.init(numTilesX * gridSize, numTilesY * gridSize, channels);
 
 	for (int tileY = 0; tileY < numTilesY; tileY++)
 	{
@@ -160,32 +427,67 @@ void Image::computeTileMeans(Image& tileMeans, int tileSize) const
 		{
 			const int tileStartX = tileX * tileSize;
 
-			float meanR, meanG, meanB, meanA;
-			computeTileMean(meanR, meanG, meanB, meanA, tileStartX, tileStartY, tileSize);
+			float tileR = 0.0f, tileG = 0.0f, tileB = 0.0f, tileA = 0.0f;
+			if (gridSize > 1)
+				computeRectMean(tileR, tileG, tileB, tileA, tileStartX, tileStartY, tileSize, tileSize);
 
-			tileMeans.writePixel(meanR, meanG, meanB, meanA, tileX, tileY);
+			for (int gridY = 0; gridY < gridSize; gridY++)
+			{
+				int rectStartY, rectHeight;
+				getGridRect(tileSize, gridSize, gridY, rectStartY, rectHeight);
+
+				for (int gridX = 0; gridX < gridSize; gridX++)
+				{
+					int rectStartX, rectWidth;
+					getGridRect(tileSize, gridSize, gridX, rectStartX, rectWidth);
+
+					float meanR, meanG, meanB, meanA;
+					if (!computeRectMean(meanR, meanG, meanB, meanA, tileStartX + rectStartX, tileStartY + rectStartY,
+						rectWidth, rectHeight) && gridSize > 1)
+					{
+						meanR = tileR;
+						meanG = tileG;
+						meanB = tileB;
+						meanA = tileA;
+					}
+
+					gridMeans.writePixel(meanR, meanG, meanB, meanA, tileX * gridSize + gridX, tileY * gridSize + gridY);
+				}
+			}
 		}
 	}
 }
 
+void Image::getGridRect(int tileSize, int gridSize, int index, int& start, int& length)
+{
+	start = index * tileSize / gridSize;
+	length = (index + 1) * tileSize / gridSize - start;
+}
+
 void Image::replaceTile(const Image& tile, int tileStartX, int tileStartY)
 {
-	assert(tileStartX < width);
-	assert(tileStartY < height);
+	replaceTile(tile.getData(), tile.getWidth(), tile.getHeight(), tile.getNumChannels(), tileStartX, tileStartY);
+}
 
-	for (int tileY = 0; tileY < tile.getHeight(); tileY++)
+void Image::replaceTile(const unsigned char* tileData, int tileWidth, int tileHeight, int tileChannels,
+	int tileStartX, int tileStartY)
+{
+	assert(tileData != nullptr);
+	assert(tileStartX >= 0 && tileStartX < width);
+	assert(tileStartY >= 0 && tileStartY < height);
+
+	// Clip once, then copy whole rows
+	const int copyWidth = std::min(tileWidth, width - tileStartX);
+	const int copyHeight = std::min(tileHeight, height - tileStartY);
+	const size_t tileRowSize = size_t(tileWidth) * tileChannels;
+	for (int tileY = 0; tileY < copyHeight; tileY++)
 	{
-		const int y = tileStartY + tileY;
-		for (int tileX = 0; tileX < tile.getWidth(); tileX++)
-		{
-			const int x = tileStartX + tileX;
-			if (x < width && y < height)
-			{
-				Pixel pixel;
-				tile.readPixel(pixel, tileX, tileY);
-				writePixel(pixel, x, y);
-			}
-		}
+		const unsigned char* source = tileData + tileY * tileRowSize;
+		unsigned char* destination = data + (size_t(tileStartY + tileY) * width + tileStartX) * channels;
+		if (tileChannels == channels)
+			std::memcpy(destination, source, size_t(copyWidth) * channels);
+		else
+			convertPixels(source, tileChannels, destination, channels, copyWidth);
 	}
 }
 
@@ -224,12 +526,16 @@ void Image::writePixel(float r, float g, float b, float a, int x, int y)
 	assert(a >= 0.0f);
 	assert(a <= 1.0f);
 
+	// Two channel images are grey and alpha
 	const int pixelIndex = (y * width + x) * channels;
 	data[pixelIndex + 0] = uint8_t(r * 255.0f);
-	if (channels > 1)
-		data[pixelIndex + 1] = uint8_t(g * 255.0f);
+	if (channels == 2)
+		data[pixelIndex + 1] = uint8_t(a * 255.0f);
 	if (channels > 2)
+	{
+		data[pixelIndex + 1] = uint8_t(g * 255.0f);
 		data[pixelIndex + 2] = uint8_t(b * 255.0f);
+	}
 	if (channels > 3)
 		data[pixelIndex + 3] = uint8_t(a * 255.0f);
 }
@@ -241,29 +547,34 @@ void Image::cropToSquare(Image& croppedImage, int w, int h) const
 	assert(w < MAX_SIDE_LENGTH);
 	assert(h < MAX_SIDE_LENGTH);
 
-	int smallestSide = getWidth();
+	// The crop is chosen on the upright image
+	const bool swapsAxes = orientation >= 5;
+	const int uprightWidth = swapsAxes ? getHeight() : getWidth();
+	const int uprightHeight = swapsAxes ? getWidth() : getHeight();
+
+	int smallestSide = uprightWidth;
 	float s0 = 0.0f;
 	float t0 = 0.0f;
 	float s1 = 1.0f;
 	float t1 = 1.0f;
 
-	if (getWidth() > getHeight())
+	if (uprightWidth > uprightHeight)
 	{
 		// Horizontal image
-		smallestSide = getHeight();
-		s0 = float(getWidth() - getHeight()) * 0.5f / float(getWidth());
+		smallestSide = uprightHeight;
+		s0 = float(uprightWidth - uprightHeight) * 0.5f / float(uprightWidth);
 		t0 = 0.0f;
 		s1 = 1.0f - s0;
 		t1 = 1.0f;
 	}
-	else if (getWidth() < getHeight())
+	else if (uprightWidth < uprightHeight)
 	{
 		// Vertical image
-		smallestSide = getWidth();
+		smallestSide = uprightWidth;
 		s0 = 0.0f;
-		t0 = (float(getHeight() - getWidth()) * 0.5f / float(getHeight())) * 0.5f;
+		t0 = (float(uprightHeight - uprightWidth) * 0.5f / float(uprightHeight)) * 0.5f;
 		s1 = 1.0f;
-		t1 = t0 + float(getWidth()) / float(getHeight());
+		t1 = t0 + float(uprightWidth) / float(uprightHeight);
 	}
 
 	if (w == 0)
@@ -271,17 +582,47 @@ void Image::cropToSquare(Image& croppedImage, int w, int h) const
 	if (h == 0)
 		h = smallestSide;
 
-	croppedImage.init(w, h, getNumChannels());
+	// Map the crop rectangle to stored coordinates, where the resampling happens
+	const bool flipsU = orientation == 2 || orientation == 3 || orientation == 7 || orientation == 8;
+	const bool flipsV = orientation == 3 || orientation == 4 || orientation == 6 || orientation == 7;
+	float u0 = swapsAxes ? t0 : s0;
+	float u1 = swapsAxes ? t1 : s1;
+	float v0 = swapsAxes ? s0 : t0;
+	float v1 = swapsAxes ? s1 : t1;
+	if (flipsU)
+	{
+		std::swap(u0, u1);
+		u0 = 1.0f - u0;
+		u1 = 1.0f - u1;
+	}
+	if (flipsV)
+	{
+		std::swap(v0, v1);
+		v0 = 1.0f - v0;
+		v1 = 1.0f - v1;
+	}
+
+	// Resample in stored order, then reorder only the cropped pixels
+	Image storedCrop;
+	Image& resampledImage = orientation == 1 ? croppedImage : storedCrop;
+	resampledImage.init(swapsAxes ? h : w, swapsAxes ? w : h, getNumChannels());
 
 	int alphaChannel = getNumChannels() == 4 ? STBIR_FLAG_ALPHA_PREMULTIPLIED : STBIR_ALPHA_CHANNEL_NONE;
 
 	stbir_resize_region(data, getWidth(), getHeight(), 0,
-		croppedImage.data, croppedImage.getWidth(), croppedImage.getHeight(), 0,
+		resampledImage.data, resampledImage.getWidth(), resampledImage.getHeight(), 0,
 		STBIR_TYPE_UINT8, getNumChannels(), alphaChannel, 0,
 		STBIR_EDGE_CLAMP, STBIR_EDGE_CLAMP,
 		STBIR_FILTER_DEFAULT, STBIR_FILTER_DEFAULT,
 		STBIR_COLORSPACE_LINEAR, nullptr,
-		s0, t0, s1, t1);
+		u0, v0, u1, v1);
+
+	if (orientation != 1)
+	{
+		storedCrop.orientation = orientation;
+		storedCrop.applyOrientation();
+		croppedImage = std::move(storedCrop);
+	}
 }
 
 void Image::resize(Image& resizedImage, int w, int h) const
@@ -290,6 +631,84 @@ void Image::resize(Image& resizedImage, int w, int h) const
 	stbir_resize_uint8(data, getWidth(), getHeight(), 0, resizedImage.data, w, h, 0, channels);
 }
 
+void Image::applyOrientation()
+{
+	if (orientation == 1)
+		return;
+
+	const int storedWidth = getWidth();
+	const int storedHeight = getHeight();
+	const int storedOrientation = orientation;
+	unsigned char* storedData = data;
+	data = nullptr;
+
+	// Orientations 5 to 8 swap the axes
+	if (storedOrientation >= 5)
+		init(storedHeight, storedWidth, getNumChannels());
+	else
+		init(storedWidth, storedHeight, getNumChannels());
+
+	// Along an upright row, the stored position moves by a constant step
+	for (int y = 0; y < getHeight(); y++)
+	{
+		int startX, startY, nextX, nextY;
+		getStoredPosition(storedOrientation, storedWidth, storedHeight, 0, y, startX, startY);
+		getStoredPosition(storedOrientation, storedWidth, storedHeight, 1, y, nextX, nextY);
+		const int step = ((nextY - startY) * storedWidth + (nextX - startX)) * channels;
+
+		const unsigned char* source = storedData + (startY * storedWidth + startX) * channels;
+		unsigned char* destination = data + y * getWidth() * channels;
+		for (int x = 0; x < getWidth(); x++, source += step, destination += channels)
+		{
+			for (int channel = 0; channel < channels; channel++)
+				destination[channel] = source[channel];
+		}
+	}
+
+	free(storedData);
+}
+
+void Image::convertPixels(const unsigned char* source, int sourceChannels,
+	unsigned char* destination, int destinationChannels, int numPixels)
+{
+	assert(sourceChannels > 0 && sourceChannels <= MAX_CHANNELS);
+	assert(destinationChannels > 0 && destinationChannels <= MAX_CHANNELS);
+
+	if (sourceChannels == destinationChannels)
+	{
+		std::memcpy(destination, source, size_t(numPixels) * sourceChannels);
+		return;
+	}
+
+	// Follows readPixelInternal and writePixel; 8 bit values survive the round trip
+	// through floats, so it can all stay in integers
+	for (int pixelIndex = 0; pixelIndex < numPixels; pixelIndex++)
+	{
+		const uint8_t r = source[0];
+		const uint8_t g = sourceChannels > 2 ? source[1] : r;
+		const uint8_t b = sourceChannels > 2 ? source[2] : r;
+		uint8_t a = 255;
+		if (sourceChannels == 2)
+			a = source[1];
+		else if (sourceChannels > 3)
+			a = source[3];
+
+		destination[0] = r;
+		if (destinationChannels == 2)
+			destination[1] = a;
+		if (destinationChannels > 2)
+		{
+			destination[1] = g;
+			destination[2] = b;
+		}
+		if (destinationChannels > 3)
+			destination[3] = a;
+
+		source += sourceChannels;
+		destination += destinationChannels;
+	}
+}
+
 void Image::readPixelInternal(float& r, float& g, float& b, float& a,
 	const unsigned char* source, int width, int height, int nChannels, int x, int y)
 {
@@ -299,135 +718,281 @@ void Image::readPixelInternal(float& r, float& g, float& b, float& a,
 	assert(x < width);
 	assert(y < height);
 	assert(nChannels > 0);
-	assert(nChannels < MAX_CHANNELS);
+	assert(nChannels <= MAX_CHANNELS);
 
+	// Missing channels are filled in: grey is replicated and alpha defaults to opaque
 	const uint8_t* p = &source[(y * width + x) * nChannels];
 	r = float(*(p + 0)) / 255.0f;
-	if (nChannels > 1)
-		g = float(*(p + 1)) / 255.0f;
-	if (nChannels > 2)
-		b = float(*(p + 2)) / 255.0f;
-	if (nChannels > 3)
+	g = nChannels > 2 ? float(*(p + 1)) / 255.0f : r;
+	b = nChannels > 2 ? float(*(p + 2)) / 255.0f : r;
+	a = 1.0f;
+	if (nChannels == 2)
+		a = float(*(p + 1)) / 255.0f;
+	else if (nChannels > 3)
 		a = float(*(p + 3)) / 255.0f;
 }
 
-int Image::getOrientationFromExif(const char* filename) const
+bool Image::loadExifThumbnail(const unsigned char* buffer, const ImageMetadata& metadata, int minSideLength)
 {
-	static const int unspecifiedOrientation = 0;
+	assert(minSideLength > 0);
+	assert(metadata.thumbnailLength > 0);
+	assert(data == nullptr);
+
+	int thumbnailWidth = 0;
+	int thumbnailHeight = 0;
+	int thumbnailChannels = 0;
+	unsigned char* thumbnailData = stbi_load_from_memory(buffer + metadata.thumbnailOffset, int(metadata.thumbnailLength),
+		&thumbnailWidth, &thumbnailHeight, &thumbnailChannels, 0);
+	if (thumbnailData == nullptr)
+		return false;
 
-	std::ifstream file(filename, std::ios::in | std::ios::binary);
-	if (!file.is_open())
+	// Thumbnails have a fixed size, and cameras pad them with bars when the aspect
+	// ratio of the picture differs. Keep the part that matches the full image.
+	int contentX = 0;
+	int contentY = 0;
+	int contentWidth = thumbnailWidth;
+	int contentHeight = thumbnailHeight;
+	if (metadata.width > 0 && metadata.height > 0)
 	{
-		std::cerr << "Could not open file " << filename << " for reading." << std::endl;
-		return unspecifiedOrientation;
+		const float imageAspect = float(metadata.width) / float(metadata.height);
+		if (float(thumbnailWidth) > float(thumbnailHeight) * imageAspect)
+			contentWidth = int(float(thumbnailHeight) * imageAspect + 0.5f);
+		else
+			contentHeight = int(float(thumbnailWidth) / imageAspect + 0.5f);
+		contentX = (thumbnailWidth - contentWidth) / 2;
+		contentY = (thumbnailHeight - contentHeight) / 2;
 	}
 
-	file.seekg(0, std::ios::end);
-	const size_t fileSize = file.tellg();
-	file.seekg(0, std::ios::beg);
+	if (std::min(contentWidth, contentHeight) < minSideLength)
+	{
+		stbi_image_free(thumbnailData);
+		return false;
+	}
 
-	unsigned char *buffer = new unsigned char[fileSize];
-	file.read(reinterpret_cast<char*>(buffer), fileSize);
-	const int bytesRead = file.gcount();
-	file.close();
-	if (bytesRead != fileSize)
+	init(contentWidth, contentHeight, thumbnailChannels);
+	const int contentRowSize = contentWidth * thumbnailChannels;
+	for (int y = 0; y < contentHeight; y++)
 	{
-		std::cerr << "Cannot read file " << filename << "." << std::endl;
-		delete[] buffer;
-		return unspecifiedOrientation;
+		const unsigned char* sourceRow = thumbnailData + ((contentY + y) * thumbnailWidth + contentX) * thumbnailChannels;
+		std::memcpy(data + y * contentRowSize, sourceRow, contentRowSize);
 	}
+	stbi_image_free(thumbnailData);
+
+	return true;
+}
+
+#ifdef MOSAIX_HAS_LIBJPEG
+namespace
+{
+	struct JpegErrorManager
+	{
+		jpeg_error_mgr manager;
+		jmp_buf jumpBuffer;
+	};
 
-	easyexif::EXIFInfo info;
-	int parseResult = info.parseFrom(buffer, fileSize);
-	delete[] buffer;
-	if (parseResult != PARSE_EXIF_SUCCESS)
+	void onJpegError(j_common_ptr info)
 	{
-		if (parseResult == PARSE_EXIF_ERROR_CORRUPT)
-		{
-			std::cerr << "Error parsing EXIF: corrupt data." << std::endl;
-		}
-		return unspecifiedOrientation;
+		// Unwind back to loadScaledJpeg instead of exiting
+		JpegErrorManager* errorManager = reinterpret_cast<JpegErrorManager*>(info->err);
+		longjmp(errorManager->jumpBuffer, 1);
 	}
 
-	return info.Orientation;
+	void onJpegMessage(j_common_ptr)
+	{
+		// Warnings are not fatal, and stb_image would not report them either
+	}
 }
+#endif
 
-// Get necessary rotation to orient image back to normal
-int Image::getRotationFromOrientation(int orientation) const
+bool Image::loadScaledJpeg(const unsigned char* buffer, size_t size, int minSideLength, int& scaleDenominator)
 {
-	// Normal orientation, or vertically mirrored
-	if (orientation == 1 || orientation == 2)
+#ifdef MOSAIX_HAS_LIBJPEG
+	assert(minSideLength > 0);
+	assert(data == nullptr);
+
+	// Only plain C data lives between setjmp and a possible longjmp
+	jpeg_decompress_struct info;
+	JpegErrorManager errorManager;
+	info.err = jpeg_std_error(&errorManager.manager);
+	errorManager.manager.error_exit = onJpegError;
+	errorManager.manager.output_message = onJpegMessage;
+	unsigned char* volatile pixels = nullptr;
+
+	if (setjmp(errorManager.jumpBuffer))
 	{
-		// No rotation
-		return 0;
+		jpeg_destroy_decompress(&info);
+		free(pixels);
+		return false;
 	}
-	// Oriented at a 270 degree angle
-	if (orientation == 5 || orientation == 6)
+
+	jpeg_create_decompress(&info);
+	jpeg_mem_src(&info, buffer, static_cast<unsigned long>(size));
+	jpeg_read_header(&info, TRUE);
+
+	if (info.jpeg_color_space == JCS_GRAYSCALE)
 	{
-		// Rotate by remaining 90 degrees
-		return 1;
+		info.out_color_space = JCS_GRAYSCALE;
 	}
-	// Oriented at a 180 degree angle
-	if (orientation == 3 || orientation == 4)
+	else if (info.jpeg_color_space == JCS_YCbCr || info.jpeg_color_space == JCS_RGB)
 	{
-		// Rotate by 180 degrees
-		return 2;
+		info.out_color_space = JCS_RGB;
 	}
-	// Oriented at a 90 degree angle
-	if (orientation == 7 || orientation == 8)
+	else
 	{
-		// Rotate by 270 degrees
-		return 3;
+		// CMYK and other colour spaces go through stb_image
+		jpeg_destroy_decompress(&info);
+		return false;
 	}
-	return 0;
-}
 
-void Image::rotate(int ninetyDegreesRotateAmount)
-{
-	if (ninetyDegreesRotateAmount == 0)
-		return;
+	// Pick the smallest DCT scale whose output still covers minSideLength
+	info.scale_num = 1;
+	for (int denominator = 8; denominator >= 1; denominator /= 2)
+	{
+		info.scale_denom = denominator;
+		jpeg_calc_output_dimensions(&info);
+		if (int(std::min(info.output_width, info.output_height)) >= minSideLength)
+			break;
+	}
 
-	int savedWidth = getWidth();
-	int savedHeight = getHeight();
-	unsigned char* savedData = data;
-	data = nullptr;
+	if (int(info.output_width) >= MAX_SIDE_LENGTH || int(info.output_height) >= MAX_SIDE_LENGTH)
+	{
+		jpeg_destroy_decompress(&info);
+		return false;
+	}
 
-	if (ninetyDegreesRotateAmount == 1 || ninetyDegreesRotateAmount == 3)
+	jpeg_start_decompress(&info);
+
+	const int rowSize = int(info.output_width) * info.output_components;
+	pixels = static_cast<unsigned char*>(malloc(size_t(rowSize) * info.output_height));
+	while (info.output_scanline < info.output_height)
 	{
-		init(getHeight(), getWidth(), getNumChannels());
+		JSAMPROW row = pixels + size_t(info.output_scanline) * rowSize;
+		jpeg_read_scanlines(&info, &row, 1);
 	}
-	else
+
+	jpeg_finish_decompress(&info);
+	jpeg_destroy_decompress(&info);
+
+	width = int(info.output_width);
+	height = int(info.output_height);
+	channels = info.output_components;
+	data = pixels;
+	scaleDenominator = int(info.scale_denom);
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool Image::canDecodeScaledJpeg()
+{
+#ifdef MOSAIX_HAS_LIBJPEG
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool Image::probeMetadata(const unsigned char* buffer, size_t size, ImageMetadata& metadata)
+{
+	metadata = ImageMetadata();
+
+	if (size < 4 || buffer[0] != 0xFF || buffer[1] != 0xD8)
 	{
-		init(getWidth(), getHeight(), getNumChannels());
+		// Other formats carry no orientation, their header is enough
+		return stbi_info_from_memory(buffer, int(size), &metadata.width, &metadata.height, &metadata.channels) != 0;
 	}
 
-	Pixel pixel;
-	for (int y = 0; y < getHeight(); y++)
+	metadata.isJpeg = true;
+
+	// Walk the marker segments; EXIF is stored in APP1, which precedes the frame header
+	size_t offset = 2;
+	while (offset + 4 <= size)
 	{
-		for (int x = 0; x < getWidth(); x++)
+		if (buffer[offset] != 0xFF)
+			return false;
+
+		const unsigned char marker = buffer[offset + 1];
+		// Fill bytes, and markers without a payload
+		if (marker == 0xFF)
 		{
-			int sourceX = x;
-			int sourceY = y;
-			if (ninetyDegreesRotateAmount == 1)
-			{
-				sourceX = y;
-				sourceY = savedHeight - 1 - x;
-			}
-			else if (ninetyDegreesRotateAmount == 2)
+			offset++;
+			continue;
+		}
+		if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8))
+		{
+			offset += 2;
+			continue;
+		}
+		// Start of scan or end of image without a frame header
+		if (marker == 0xDA || marker == 0xD9)
+			return false;
+
+		const size_t segmentLength = (size_t(buffer[offset + 2]) << 8) | buffer[offset + 3];
+		if (segmentLength < 2 || offset + 2 + segmentLength > size)
+			return false;
+
+		const unsigned char* segment = buffer + offset + 4;
+		const size_t segmentSize = segmentLength - 2;
+
+		if (marker == 0xE1 && segmentSize >= 6 && std::memcmp(segment, "Exif\0\0", 6) == 0)
+		{
+			easyexif::EXIFInfo info;
+			const int parseResult = info.parseFromEXIFSegment(segment, unsigned(segmentSize));
+			if (parseResult == PARSE_EXIF_SUCCESS)
 			{
-				sourceX = savedWidth - 1 - x;
-				sourceY = savedHeight - 1 - y;
+				metadata.orientation = info.Orientation;
+				if (info.ThumbnailLength > 0)
+				{
+					metadata.thumbnailOffset = size_t(segment - buffer) + info.ThumbnailOffset;
+					metadata.thumbnailLength = info.ThumbnailLength;
+				}
 			}
-			else if (ninetyDegreesRotateAmount == 3)
+			else if (parseResult == PARSE_EXIF_ERROR_CORRUPT)
 			{
-				sourceX = savedWidth - 1 - y;
-				sourceY = x;
+				std::cerr << "Error parsing EXIF: corrupt data." << std::endl;
 			}
-			readPixelInternal(pixel.r, pixel.g, pixel.b, pixel.a,
-				savedData, savedWidth, savedHeight, getNumChannels(), sourceX, sourceY);
-			writePixel(pixel, x, y);
 		}
+
+		// Any start of frame marker, leaving out DHT, JPG and DAC which share the range
+		if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+		{
+			if (segmentSize < 6)
+				return false;
+
+			metadata.height = (int(segment[1]) << 8) | segment[2];
+			metadata.width = (int(segment[3]) << 8) | segment[4];
+			metadata.channels = segment[5];
+			return true;
+		}
+
+		offset += 2 + segmentLength;
 	}
 
-	delete savedData;
+	return false;
+}
+
+// Find where pixel (x, y) of the upright image is stored, for an EXIF orientation
+void Image::getStoredPosition(int orientation, int storedWidth, int storedHeight, int x, int y,
+	int& storedX, int& storedY)
+{
+	switch (orientation)
+	{
+	// Mirrored horizontally
+	case 2: storedX = storedWidth - 1 - x; storedY = y; break;
+	// Rotated by 180 degrees
+	case 3: storedX = storedWidth - 1 - x; storedY = storedHeight - 1 - y; break;
+	// Mirrored vertically
+	case 4: storedX = x; storedY = storedHeight - 1 - y; break;
+	// Transposed
+	case 5: storedX = y; storedY = x; break;
+	// Rotated by 90 degrees clockwise to display
+	case 6: storedX = y; storedY = storedHeight - 1 - x; break;
+	// Transversed
+	case 7: storedX = storedWidth - 1 - y; storedY = storedHeight - 1 - x; break;
+	// Rotated by 90 degrees counter clockwise to display
+	case 8: storedX = storedWidth - 1 - y; storedY = x; break;
+	default: storedX = x; storedY = y; break;
+	}
 }
@@ -1,41 +1,115 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
 struct Pixel;
 
+// Metadata read from the headers of an encoded image, without decoding it
+struct ImageMetadata
+{
+	int width = 0;
+	int height = 0;
+	int channels = 0;
+	// EXIF orientation, 0 if unspecified
+	int orientation = 0;
+	bool isJpeg = false;
+	// Location of an embedded JPEG thumbnail within the encoded buffer
+	size_t thumbnailOffset = 0;
+	size_t thumbnailLength = 0;
+};
+
 class Image
 {
 public:
+	Image() = default;
+	Image(const Image&) = delete;
+	Image(Image&& other);
 	virtual ~Image();
 
+	Image& operator=(const Image&) = delete;
+	Image& operator=(Image&& other);
+
+
 	void init(int w, int h, int nChannels);
 	void reset();
 	bool isValid() const;
-	bool load(const char* filename);
+	// A positive minSideLength lets JPEGs be decoded at 1/2, 1/4 or 1/8 scale, as long as
+	// the shortest side of the result stays at least minSideLength pixels long.
+	// With allowExifThumbnail, the embedded EXIF thumbnail is used instead when it is
+	// large enough.
+	// With keepStoredOrientation, pixels are left in the order they were stored in and the
+	// EXIF orientation is only recorded, to be applied by cropToSquare or applyOrientation.
+	bool load(const char* filename, int minSideLength = 0, bool allowExifThumbnail = false,
+		bool keepStoredOrientation = false);
+	// Same as load(), from an encoded file held in memory; name is only used in messages
+	bool loadFromMemory(const unsigned char* buffer, size_t size, const char* name,
+		int minSideLength = 0, bool allowExifThumbnail = false, bool keepStoredOrientation = false);
 	bool write(const char* filename) const;
 	void computeTileMean(Pixel& meanPixel, int tileStartX, int tileStartY, int tileSize) const;
 	void computeTileMean(float& meanR, float& meanG, float& meanB, float& meanA, int tileStartX, int tileStartY, int tileSize) const;
 	void computeTileMeans(Image& tileMeans, int tileSize) const;
+	// Mean of the part of a rectangle that lies inside the image; returns the number of pixels averaged.
+	// Sums are exact, in integers.
+	int computeRectMean(float& meanR, float& meanG, float& meanB, float& meanA, int startX, int startY, int w, int h) const;
+	// Like computeTileMeans, with every tile split into a gridSize x gridSize grid of rectangles.
+	// The means of tile (x, y) are the gridSize x gridSize pixels of gridMeans starting at
+	// (x * gridSize, y * gridSize). Rectangles left empty by the image border get the tile mean.
+	void computeGridMeans(Image& gridMeans, int tileSize, int gridSize) const;
+	// Start and length of rectangle index along a side of a tile split into gridSize parts
+	static void getGridRect(int tileSize, int gridSize, int index, int& start, int& length);
+	using RectMeanFunction = std::function<int(float& meanR, float& meanG, float& meanB, float& meanA,
+		int startX, int startY, int w, int h)>;
+	// The walk behind computeGridMeans over a width x height image with the given channels,
+	// taking rectangle means from computeRectMean
+	static void fillGridMeans(Image& gridMeans, int width, int height, int channels, int tileSize, int gridSize,
+		const RectMeanFunction& computeRectMean);
 	void replaceTile(const Image& tile, int tileStartX, int tileStartY);
+	void replaceTile(const unsigned char* tileData, int tileWidth, int tileHeight, int tileChannels,
+		int tileStartX, int tileStartY);
 	int getWidth() const { return width; }
 	int getHeight() const { return height; }
 	int getNumChannels() const { return channels; }
+	// EXIF orientation the pixels are stored in, 1 once upright
+	int getOrientation() const { return orientation; }
 	int sizeInBytes() const;
+	unsigned char* getData() { return data; }
+	const unsigned char* getData() const { return data; }
 	void readPixel(Pixel& pixel, int x, int y) const;
 	void readPixel(float& r, float& g, float& b, float& a, int x, int y) const;
 	void writePixel(const Pixel& pixel, int x, int y);
 	void writePixel(float r, float g, float b, float a, int x, int y);
+	// The crop is taken from the upright image and the result is upright. A pending
+	// orientation is folded into the sampling, only the cropped pixels get reordered.
 	void cropToSquare(Image& croppedImage, int w = 0, int h = 0) const;
 	void resize(Image& resizedImage, int w, int h) const;
+	// Reorder the pixels so that the image is upright, undoing rotations and mirroring
+	void applyOrientation();
+
+	// Mean of numSamples pixels whose channels add up to sums, with missing channels filled in
+	// like readPixel
+	static void computeMeanFromSums(const uint64_t* sums, int nChannels, int numSamples,
+		float& meanR, float& meanG, float& meanB, float& meanA);
+	// Whether load() can decode JPEGs at reduced scale, which needs libjpeg
+	static bool canDecodeScaledJpeg();
+	// Only walks the headers: JPEG markers up to the frame header, or the header of other formats
+	static bool probeMetadata(const unsigned char* buffer, size_t size, ImageMetadata& metadata);
+	// Same result as reading each pixel from one layout and writing it to the other
+	static void convertPixels(const unsigned char* source, int sourceChannels,
+		unsigned char* destination, int destinationChannels, int numPixels);
 
 private:
 	int width = 0;
 	int height = 0;
 	int channels = 0;
+	int orientation = 1;
 	unsigned char* data = nullptr;
 
 	static void readPixelInternal(float& r, float& g, float& b, float& a,
 		const unsigned char* source, int width, int height, int nChannels, int x, int y);
-	int getOrientationFromExif(const char* filename) const;
-	int getRotationFromOrientation(int orientation) const;
-	void rotate(int ninetyDegreesRotateAmount);
+	bool loadExifThumbnail(const unsigned char* buffer, const ImageMetadata& metadata, int minSideLength);
+	bool loadScaledJpeg(const unsigned char* buffer, size_t size, int minSideLength, int& scaleDenominator);
+	static void getStoredPosition(int orientation, int storedWidth, int storedHeight, int x, int y,
+		int& storedX, int& storedY);
 };
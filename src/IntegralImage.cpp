@@ -0,0 +1,95 @@
+#include <IntegralImage.h>
+
+#include <Image.h>
+
+#include <algorithm>
+#include <cassert>
+
+#define MAX_CHANNELS 4
+
+void IntegralImage::build(const Image& image)
+{
+	assert(image.isValid());
+
+	width = image.getWidth();
+	height = image.getHeight();
+	channels = image.getNumChannels();
+
+	const size_t rowSize = size_t(width + 1) * channels;
+	sums.assign(rowSize * (height + 1), 0);
+
+	const unsigned char* data = image.getData();
+	for (int y = 0; y < height; y++)
+	{
+		const unsigned char* pixels = data + size_t(y) * width * channels;
+		const uint64_t* aboveRow = &sums[size_t(y) * rowSize];
+		uint64_t* row = &sums[size_t(y + 1) * rowSize];
+
+		uint64_t rowSums[MAX_CHANNELS] = {};
+		for (int x = 0; x < width; x++)
+		{
+			for (int channel = 0; channel < channels; channel++)
+			{
+				rowSums[channel] += pixels[size_t(x) * channels + channel];
+				const size_t sumIndex = size_t(x + 1) * channels + channel;
+				row[sumIndex] = aboveRow[sumIndex] + rowSums[channel];
+			}
+		}
+	}
+}
+
+void IntegralImage::reset()
+{
+	width = 0;
+	height = 0;
+	channels = 0;
+	sums.clear();
+	sums.shrink_to_fit();
+}
+
+bool IntegralImage::isValid() const
+{
+	return width > 0 && height > 0 && channels > 0 && !sums.empty();
+}
+
+int IntegralImage::computeRectMean(float& meanR, float& meanG, float& meanB, float& meanA, int startX, int startY, int w, int h) const
+{
+	assert(isValid());
+	assert(startX >= 0 && startY >= 0);
+
+	const int endX = std::min(startX + w, width);
+	const int endY = std::min(startY + h, height);
+	if (endX <= startX || endY <= startY)
+	{
+		meanR = 0.0f;
+		meanG = 0.0f;
+		meanB = 0.0f;
+		meanA = 0.0f;
+		return 0;
+	}
+
+	const size_t rowSize = size_t(width + 1) * channels;
+	const uint64_t* topLeft = &sums[size_t(startY) * rowSize + size_t(startX) * channels];
+	const uint64_t* topRight = &sums[size_t(startY) * rowSize + size_t(endX) * channels];
+	const uint64_t* bottomLeft = &sums[size_t(endY) * rowSize + size_t(startX) * channels];
+	const uint64_t* bottomRight = &sums[size_t(endY) * rowSize + size_t(endX) * channels];
+
+	uint64_t rectSums[MAX_CHANNELS];
+	for (int channel = 0; channel < channels; channel++)
+		rectSums[channel] = bottomRight[channel] - bottomLeft[channel] - topRight[channel] + topLeft[channel];
+
+	const int numSamples = (endX - startX) * (endY - startY);
+	Image::computeMeanFromSums(rectSums, channels, numSamples, meanR, meanG, meanB, meanA);
+	return numSamples;
+}
+
+void IntegralImage::computeGridMeans(Image& gridMeans, int tileSize, int gridSize) const
+{
+	assert(isValid());
+
+	Image::fillGridMeans(gridMeans, width, height, channels, tileSize, gridSize,
+		[this](float& meanR, float& meanG, float& meanB, float& meanA, int startX, int startY, int w, int h)
+		{
+			return computeRectMean(meanR, meanG, meanB, meanA, startX, startY, w, h);
+		});
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+class Image;
+
+// Summed-area table of an image: for every position, the sums of each channel over all
+// pixels above and to the left of it. The mean of any rectangle then takes four reads per
+// channel, whatever its size, so cell means at any tile size or offset come cheap once
+// the table is built.
+class IntegralImage
+{
+public:
+	void build(const Image& image);
+	void reset();
+	bool isValid() const;
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+	// Same results and conventions as Image::computeRectMean, with missing channels filled
+	// in like Image::readPixel
+	int computeRectMean(float& meanR, float& meanG, float& meanB, float& meanA, int startX, int startY, int w, int h) const;
+	// Same walk and layout as Image::computeGridMeans, reading the table instead of the pixels
+	void computeGridMeans(Image& gridMeans, int tileSize, int gridSize) const;
+
+private:
+	int width = 0;
+	int height = 0;
+	int channels = 0;
+	// (width + 1) x (height + 1) positions of channels sums, the first row and column are zero
+	std::vector<uint64_t> sums;
+};
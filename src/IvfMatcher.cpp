@@ -0,0 +1,317 @@
+#include <IvfMatcher.h>
+
+#include <NearestTiles.h>
+#include <Parallel.h>
+#include <SimdMatcher.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <system_error>
+#include <utility>
+
+#define IVF_VERSION 1
+#define IVF_KMEANS_ITERATIONS 16
+// Tiles sampled per list to train the centroids
+#define IVF_TRAINING_POINTS_PER_LIST 64
+#define IVF_ASSIGNMENTS_PER_TASK 1024
+
+static const char ivfMagic[4] = { 'M', 'S', 'X', 'I' };
+
+namespace
+{
+	// Lists are ranked in a fixed-size heap, so only probing every list may go past its size
+	int clampNumProbes(int numProbes, int numLists)
+	{
+		numProbes = std::max(1, std::min(numProbes, numLists));
+		return numProbes < numLists ? std::min(numProbes, MAX_NEAREST_TILES) : numProbes;
+	}
+
+	struct FileHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t dimension;
+		uint32_t numTiles;
+		uint32_t numLists;
+		uint32_t padding;
+		uint64_t featuresHash;
+	};
+
+	// Nearest centroid of every point, found with an exact vectorized scan
+	void assignToCentroids(const float* centroids, int numCentroids, const float* points, int numPoints, int dimension,
+		int numThreads, std::vector<int>& assignments)
+	{
+		SimdMatcher centroidMatcher;
+		centroidMatcher.build(centroids, numCentroids, dimension);
+
+		assignments.resize(numPoints);
+		const int numTasks = (numPoints + IVF_ASSIGNMENTS_PER_TASK - 1) / IVF_ASSIGNMENTS_PER_TASK;
+		parallelFor(numTasks, numThreads, [&](int taskIndex)
+		{
+			const int endPointIndex = std::min(numPoints, (taskIndex + 1) * IVF_ASSIGNMENTS_PER_TASK);
+			for (int pointIndex = taskIndex * IVF_ASSIGNMENTS_PER_TASK; pointIndex < endPointIndex; pointIndex++)
+				assignments[pointIndex] = centroidMatcher.findNearest(points + size_t(pointIndex) * dimension);
+		});
+	}
+}
+
+IvfMatcher::IvfMatcher(const MatcherSettings& settings)
+	: numThreads(settings.numThreads)
+	, numLists(settings.ivfNumLists)
+	, numProbes(settings.ivfNumProbes)
+{
+}
+
+void IvfMatcher::build(const float* features, int numTiles, int d)
+{
+	assert(features != nullptr);
+	assert(numTiles > 0);
+	assert(d > 0);
+
+	dimension = d;
+	// A few times the square root balances the centroid scan against the list scans
+	if (numLists <= 0)
+		numLists = std::max(1, int(4.0 * std::sqrt(double(numTiles))));
+	numLists = std::min(numLists, numTiles);
+	numProbes = clampNumProbes(numProbes, numLists);
+
+	trainCentroids(features, numTiles);
+
+	std::vector<int> listIndices;
+	assignToCentroids(centroids.data(), numLists, features, numTiles, dimension, numThreads, listIndices);
+	fillLists(features, numTiles, listIndices);
+}
+
+int IvfMatcher::findNearest(const float* query) const
+{
+	int probedLists[MAX_NEAREST_TILES];
+	const bool isProbingAll = !findProbedLists(query, probedLists);
+
+	int closestIndex = -1;
+	float closestDistance = std::numeric_limits<float>::max();
+	for (int probeIndex = 0; probeIndex < numProbes; probeIndex++)
+	{
+		const int listIndex = isProbingAll ? probeIndex : probedLists[probeIndex];
+		for (int pointIndex = listStarts[listIndex]; pointIndex < listStarts[listIndex + 1]; pointIndex++)
+		{
+			const float distance = squaredDistance(query, &points[size_t(pointIndex) * dimension], dimension);
+			const int tileIndex = tileIndices[pointIndex];
+			if (distance < closestDistance || (distance == closestDistance && tileIndex < closestIndex))
+			{
+				closestIndex = tileIndex;
+				closestDistance = distance;
+			}
+		}
+	}
+	return closestIndex;
+}
+
+int IvfMatcher::findNearest(const float* query, int numNearest, int* nearestTileIndices) const
+{
+	int probedLists[MAX_NEAREST_TILES];
+	const bool isProbingAll = !findProbedLists(query, probedLists);
+
+	NearestTiles nearestTiles(numNearest);
+	for (int probeIndex = 0; probeIndex < numProbes; probeIndex++)
+	{
+		const int listIndex = isProbingAll ? probeIndex : probedLists[probeIndex];
+		for (int pointIndex = listStarts[listIndex]; pointIndex < listStarts[listIndex + 1]; pointIndex++)
+		{
+			const float distance = squaredDistance(query, &points[size_t(pointIndex) * dimension], dimension);
+			if (distance <= nearestTiles.getWorstDistance())
+				nearestTiles.offer(distance, tileIndices[pointIndex]);
+		}
+	}
+	return nearestTiles.extract(nearestTileIndices);
+}
+
+bool IvfMatcher::findProbedLists(const float* query, int* probedLists) const
+{
+	if (numProbes == numLists)
+		return false;
+
+	// Lists rank like tiles, by centroid distance and then lowest index
+	NearestTiles closestLists(numProbes);
+	for (int listIndex = 0; listIndex < numLists; listIndex++)
+	{
+		const float distance = squaredDistance(query, &centroids[size_t(listIndex) * dimension], dimension);
+		if (distance <= closestLists.getWorstDistance())
+			closestLists.offer(distance, listIndex);
+	}
+	closestLists.extract(probedLists);
+	return true;
+}
+
+bool IvfMatcher::read(const std::filesystem::path& path, const float* features, int numTiles, int d,
+	uint64_t featuresHash)
+{
+	std::ifstream file(path, std::ios::in | std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	FileHeader header = {};
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!file ||
+		std::memcmp(header.magic, ivfMagic, sizeof(ivfMagic)) != 0 ||
+		header.version != IVF_VERSION ||
+		header.dimension != uint32_t(d) ||
+		header.numTiles != uint32_t(numTiles) ||
+		header.numLists == 0 || header.numLists > header.numTiles ||
+		(numLists > 0 && header.numLists != uint32_t(numLists)) ||
+		header.featuresHash != featuresHash)
+		return false;
+
+	const int fileNumLists = int(header.numLists);
+	std::vector<float> fileCentroids(size_t(fileNumLists) * d);
+	std::vector<int32_t> listIndices(numTiles);
+	file.read(reinterpret_cast<char*>(fileCentroids.data()), std::streamsize(fileCentroids.size() * sizeof(float)));
+	file.read(reinterpret_cast<char*>(listIndices.data()), std::streamsize(listIndices.size() * sizeof(int32_t)));
+	if (!file)
+		return false;
+
+	for (const int32_t listIndex : listIndices)
+	{
+		if (listIndex < 0 || listIndex >= fileNumLists)
+			return false;
+	}
+
+	dimension = d;
+	numLists = fileNumLists;
+	numProbes = clampNumProbes(numProbes, numLists);
+	centroids = std::move(fileCentroids);
+	fillLists(features, numTiles, std::vector<int>(listIndices.begin(), listIndices.end()));
+
+	return true;
+}
+
+bool IvfMatcher::write(const std::filesystem::path& path, uint64_t featuresHash) const
+{
+	const int numTiles = int(tileIndices.size());
+
+	FileHeader header = {};
+	std::memcpy(header.magic, ivfMagic, sizeof(ivfMagic));
+	header.version = IVF_VERSION;
+	header.dimension = uint32_t(dimension);
+	header.numTiles = uint32_t(numTiles);
+	header.numLists = uint32_t(numLists);
+	header.featuresHash = featuresHash;
+
+	// Only the list of every tile is stored, the lists are rebuilt from the features
+	std::vector<int32_t> listIndices(numTiles);
+	for (int listIndex = 0; listIndex < numLists; listIndex++)
+	{
+		for (int pointIndex = listStarts[listIndex]; pointIndex < listStarts[listIndex + 1]; pointIndex++)
+			listIndices[tileIndices[pointIndex]] = listIndex;
+	}
+
+	// Write next to the destination and rename over it once complete
+	std::filesystem::path tempPath(path);
+	tempPath += ".tmp";
+
+	std::ofstream file(tempPath, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+	{
+		std::cerr << "Could not open file " << tempPath.native() << " for writing." << std::endl;
+		return false;
+	}
+
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(centroids.data()), std::streamsize(centroids.size() * sizeof(float)));
+	file.write(reinterpret_cast<const char*>(listIndices.data()), std::streamsize(listIndices.size() * sizeof(int32_t)));
+	file.close();
+
+	std::error_code error;
+	if (file)
+		std::filesystem::rename(tempPath, path, error);
+	if (!file || error)
+	{
+		std::cerr << "Could not write index '" << path.native() << "'." << std::endl;
+		std::filesystem::remove(tempPath, error);
+		return false;
+	}
+
+	std::cout << "Successfully wrote index '" << path.native() << "' with " << numLists << " lists." << std::endl;
+
+	return true;
+}
+
+void IvfMatcher::trainCentroids(const float* features, int numTiles)
+{
+	// Seeded, so that the same tiles always give the same index
+	std::mt19937 random(numTiles);
+
+	std::vector<int> sampleIndices(numTiles);
+	for (int tileIndex = 0; tileIndex < numTiles; tileIndex++)
+		sampleIndices[tileIndex] = tileIndex;
+	std::shuffle(sampleIndices.begin(), sampleIndices.end(), random);
+	const int numSamples = std::min(numTiles, numLists * IVF_TRAINING_POINTS_PER_LIST);
+
+	std::vector<float> samples(size_t(numSamples) * dimension);
+	for (int sampleIndex = 0; sampleIndex < numSamples; sampleIndex++)
+	{
+		const float* feature = features + size_t(sampleIndices[sampleIndex]) * dimension;
+		std::copy(feature, feature + dimension, samples.begin() + size_t(sampleIndex) * dimension);
+	}
+
+	// Lloyd iterations from distinct random samples
+	centroids.assign(samples.begin(), samples.begin() + size_t(numLists) * dimension);
+	std::vector<int> assignments;
+	std::vector<double> sums;
+	std::vector<int> counts;
+	std::uniform_int_distribution<int> sampleDistribution(0, numSamples - 1);
+	for (int iteration = 0; iteration < IVF_KMEANS_ITERATIONS; iteration++)
+	{
+		assignToCentroids(centroids.data(), numLists, samples.data(), numSamples, dimension, numThreads, assignments);
+
+		sums.assign(size_t(numLists) * dimension, 0.0);
+		counts.assign(numLists, 0);
+		for (int sampleIndex = 0; sampleIndex < numSamples; sampleIndex++)
+		{
+			const int listIndex = assignments[sampleIndex];
+			counts[listIndex]++;
+			for (int dimensionIndex = 0; dimensionIndex < dimension; dimensionIndex++)
+				sums[size_t(listIndex) * dimension + dimensionIndex] += samples[size_t(sampleIndex) * dimension + dimensionIndex];
+		}
+
+		for (int listIndex = 0; listIndex < numLists; listIndex++)
+		{
+			float* centroid = &centroids[size_t(listIndex) * dimension];
+			if (counts[listIndex] == 0)
+			{
+				// Restart empty clusters on a random sample
+				const float* sample = &samples[size_t(sampleDistribution(random)) * dimension];
+				std::copy(sample, sample + dimension, centroid);
+				continue;
+			}
+			for (int dimensionIndex = 0; dimensionIndex < dimension; dimensionIndex++)
+				centroid[dimensionIndex] = float(sums[size_t(listIndex) * dimension + dimensionIndex] / counts[listIndex]);
+		}
+	}
+}
+
+void IvfMatcher::fillLists(const float* features, int numTiles, const std::vector<int>& listIndices)
+{
+	listStarts.assign(numLists + 1, 0);
+	for (int tileIndex = 0; tileIndex < numTiles; tileIndex++)
+		listStarts[listIndices[tileIndex] + 1]++;
+	for (int listIndex = 0; listIndex < numLists; listIndex++)
+		listStarts[listIndex + 1] += listStarts[listIndex];
+
+	// Tiles stay in increasing order within a list
+	std::vector<int> listEnds(listStarts.begin(), listStarts.end() - 1);
+	tileIndices.resize(numTiles);
+	points.resize(size_t(numTiles) * dimension);
+	for (int tileIndex = 0; tileIndex < numTiles; tileIndex++)
+	{
+		const int pointIndex = listEnds[listIndices[tileIndex]]++;
+		tileIndices[pointIndex] = tileIndex;
+		const float* feature = features + size_t(tileIndex) * dimension;
+		std::copy(feature, feature + dimension, points.begin() + size_t(pointIndex) * dimension);
+	}
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <TileMatcher.h>
+
+#include <vector>
+
+// Approximate nearest neighbour search with an inverted file index: tiles are grouped
+// around k-means centroids, and a query only scans the groups of its numProbes closest
+// centroids. More lists make each scan shorter, more probes raise the recall; probing
+// every list gives exact results.
+class IvfMatcher : public TileMatcher
+{
+public:
+	explicit IvfMatcher(const MatcherSettings& settings);
+
+	void build(const float* features, int numTiles, int dimension) override;
+	int findNearest(const float* query) const override;
+	int findNearest(const float* query, int numNearest, int* nearestTileIndices) const override;
+	const char* getName() const override { return "ivf"; }
+
+	bool canBeSaved() const override { return true; }
+	bool read(const std::filesystem::path& path, const float* features, int numTiles, int dimension,
+		uint64_t featuresHash) override;
+	bool write(const std::filesystem::path& path, uint64_t featuresHash) const override;
+
+private:
+	int numThreads = 0;
+	int numLists = 0;
+	int numProbes = 0;
+	int dimension = 0;
+	std::vector<float> centroids;
+	// Tiles of list l are [listStarts[l], listStarts[l + 1]) in tileIndices and points
+	std::vector<int> listStarts;
+	std::vector<int> tileIndices;
+	std::vector<float> points;
+
+	// Write the numProbes lists closest to the query, closest first. Returns false without
+	// writing any when every list is probed.
+	bool findProbedLists(const float* query, int* probedLists) const;
+	void trainCentroids(const float* features, int numTiles);
+	void fillLists(const float* features, int numTiles, const std::vector<int>& listIndices);
+};
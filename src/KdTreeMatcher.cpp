@@ -0,0 +1,182 @@
+#include <KdTreeMatcher.h>
+
+#include <NearestTiles.h>
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <numeric>
+
+#define KD_TREE_LEAF_SIZE 8
+
+void KdTreeMatcher::build(const float* features, int numTiles, int d)
+{
+	assert(features != nullptr);
+	assert(numTiles > 0);
+	assert(d > 0);
+
+	dimension = d;
+	nodes.clear();
+	nodes.reserve(size_t(2 * (numTiles / KD_TREE_LEAF_SIZE + 1)));
+	tileIndices.resize(size_t(numTiles));
+	std::iota(tileIndices.begin(), tileIndices.end(), 0);
+
+	buildNode(features, 0, numTiles, -1);
+
+	points.resize(size_t(numTiles) * dimension);
+	pointIndices.resize(size_t(numTiles));
+	for (int pointIndex = 0; pointIndex < numTiles; pointIndex++)
+	{
+		const float* feature = features + size_t(tileIndices[pointIndex]) * dimension;
+		std::copy(feature, feature + dimension, points.begin() + size_t(pointIndex) * dimension);
+		pointIndices[tileIndices[pointIndex]] = pointIndex;
+	}
+
+	leafIndices.resize(size_t(numTiles));
+	for (int nodeIndex = 0; nodeIndex < int(nodes.size()); nodeIndex++)
+	{
+		if (nodes[nodeIndex].splitDimension >= 0)
+			continue;
+		for (int pointIndex = nodes[nodeIndex].begin; pointIndex < nodes[nodeIndex].end; pointIndex++)
+			leafIndices[tileIndices[pointIndex]] = nodeIndex;
+	}
+}
+
+void KdTreeMatcher::removeTile(int tileIndex)
+{
+	const int leafIndex = leafIndices[tileIndex];
+	Node& leaf = nodes[leafIndex];
+	const int pointIndex = pointIndices[tileIndex];
+	if (pointIndex >= leaf.end)
+		return;
+
+	// Swap with the last point of the leaf, tie-breaking does not depend on the order of points
+	const int lastPointIndex = leaf.end - 1;
+	const int lastTileIndex = tileIndices[lastPointIndex];
+	std::swap_ranges(points.begin() + size_t(pointIndex) * dimension, points.begin() + size_t(pointIndex + 1) * dimension,
+		points.begin() + size_t(lastPointIndex) * dimension);
+	std::swap(tileIndices[pointIndex], tileIndices[lastPointIndex]);
+	pointIndices[lastTileIndex] = pointIndex;
+	pointIndices[tileIndex] = lastPointIndex;
+	leaf.end--;
+
+	for (int nodeIndex = leafIndex; nodeIndex >= 0; nodeIndex = nodes[nodeIndex].parent)
+		nodes[nodeIndex].numPoints--;
+}
+
+int KdTreeMatcher::findNearest(const float* query) const
+{
+	int closestIndex = -1;
+	float closestDistance = std::numeric_limits<float>::max();
+	search(0, query, closestIndex, closestDistance);
+	return closestIndex;
+}
+
+int KdTreeMatcher::findNearest(const float* query, int numNearest, int* nearestTileIndices) const
+{
+	NearestTiles nearestTiles(numNearest);
+	search(0, query, nearestTiles);
+	return nearestTiles.extract(nearestTileIndices);
+}
+
+int KdTreeMatcher::buildNode(const float* features, int begin, int end, int parent)
+{
+	const int nodeIndex = int(nodes.size());
+	nodes.emplace_back();
+	nodes[nodeIndex].begin = begin;
+	nodes[nodeIndex].end = end;
+	nodes[nodeIndex].parent = parent;
+	nodes[nodeIndex].numPoints = end - begin;
+
+	if (end - begin <= KD_TREE_LEAF_SIZE)
+		return nodeIndex;
+
+	int splitDimension = 0;
+	float largestSpread = -1.0f;
+	for (int d = 0; d < dimension; d++)
+	{
+		float minValue = std::numeric_limits<float>::max();
+		float maxValue = std::numeric_limits<float>::lowest();
+		for (int pointIndex = begin; pointIndex < end; pointIndex++)
+		{
+			const float value = features[size_t(tileIndices[pointIndex]) * dimension + d];
+			minValue = std::min(minValue, value);
+			maxValue = std::max(maxValue, value);
+		}
+		if (maxValue - minValue > largestSpread)
+		{
+			splitDimension = d;
+			largestSpread = maxValue - minValue;
+		}
+	}
+
+	// Everything below the median is lower or equal, everything from it on is higher or equal
+	const int middle = begin + (end - begin) / 2;
+	std::nth_element(tileIndices.begin() + begin, tileIndices.begin() + middle, tileIndices.begin() + end,
+		[features, splitDimension, this](int a, int b)
+		{
+			return features[size_t(a) * dimension + splitDimension] < features[size_t(b) * dimension + splitDimension];
+		});
+
+	nodes[nodeIndex].splitDimension = splitDimension;
+	nodes[nodeIndex].splitValue = features[size_t(tileIndices[middle]) * dimension + splitDimension];
+	buildNode(features, begin, middle, nodeIndex);
+	const int upperChild = buildNode(features, middle, end, nodeIndex);
+	nodes[nodeIndex].upperChild = upperChild;
+
+	return nodeIndex;
+}
+
+void KdTreeMatcher::search(int nodeIndex, const float* query, int& closestIndex, float& closestDistance) const
+{
+	const Node& node = nodes[nodeIndex];
+	if (node.numPoints == 0)
+		return;
+
+	if (node.splitDimension < 0)
+	{
+		for (int pointIndex = node.begin; pointIndex < node.end; pointIndex++)
+		{
+			const float distance = squaredDistance(query, &points[size_t(pointIndex) * dimension], dimension);
+			const int tileIndex = tileIndices[pointIndex];
+			if (distance < closestDistance || (distance == closestDistance && tileIndex < closestIndex))
+			{
+				closestIndex = tileIndex;
+				closestDistance = distance;
+			}
+		}
+		return;
+	}
+
+	// The split value is a coordinate of the data, so the squared plane distance never
+	// exceeds the distance computed to any point beyond it, rounding included
+	const float planeOffset = query[node.splitDimension] - node.splitValue;
+	const bool isQueryBelow = planeOffset < 0.0f;
+	search(isQueryBelow ? nodeIndex + 1 : node.upperChild, query, closestIndex, closestDistance);
+	if (planeOffset * planeOffset <= closestDistance)
+		search(isQueryBelow ? node.upperChild : nodeIndex + 1, query, closestIndex, closestDistance);
+}
+
+void KdTreeMatcher::search(int nodeIndex, const float* query, NearestTiles& nearestTiles) const
+{
+	const Node& node = nodes[nodeIndex];
+	if (node.numPoints == 0)
+		return;
+
+	if (node.splitDimension < 0)
+	{
+		for (int pointIndex = node.begin; pointIndex < node.end; pointIndex++)
+		{
+			const float distance = squaredDistance(query, &points[size_t(pointIndex) * dimension], dimension);
+			if (distance <= nearestTiles.getWorstDistance())
+				nearestTiles.offer(distance, tileIndices[pointIndex]);
+		}
+		return;
+	}
+
+	const float planeOffset = query[node.splitDimension] - node.splitValue;
+	const bool isQueryBelow = planeOffset < 0.0f;
+	search(isQueryBelow ? nodeIndex + 1 : node.upperChild, query, nearestTiles);
+	if (planeOffset * planeOffset <= nearestTiles.getWorstDistance())
+		search(isQueryBelow ? node.upperChild : nodeIndex + 1, query, nearestTiles);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <TileMatcher.h>
+
+#include <vector>
+
+class NearestTiles;
+
+// Exact nearest neighbour search in a k-d tree with small leaf buckets.
+// Each node splits on the dimension of largest spread at the median. Subtrees are
+// only skipped when their splitting plane is strictly farther than the best match,
+// so equally distant tiles are still visited and ties resolve as in a linear scan.
+class KdTreeMatcher : public TileMatcher
+{
+public:
+	void build(const float* features, int numTiles, int dimension) override;
+	int findNearest(const float* query) const override;
+	int findNearest(const float* query, int numNearest, int* nearestTileIndices) const override;
+	const char* getName() const override { return "kdtree"; }
+
+	// Leave a tile out of later searches
+	void removeTile(int tileIndex);
+
+private:
+	struct Node
+	{
+		// Leaves have no splitting dimension and cover points [begin, end)
+		int splitDimension = -1;
+		float splitValue = 0.0f;
+		int begin = 0;
+		int end = 0;
+		// The lower child directly follows its parent
+		int upperChild = -1;
+		int parent = -1;
+		// Tiles left in the subtree, removed tiles are moved past the end of their leaf
+		int numPoints = 0;
+	};
+
+	int dimension = 0;
+	std::vector<Node> nodes;
+	// Features and tile indices, reordered so that every leaf is contiguous
+	std::vector<float> points;
+	std::vector<int> tileIndices;
+	// Point and leaf of every tile
+	std::vector<int> pointIndices;
+	std::vector<int> leafIndices;
+
+	int buildNode(const float* features, int begin, int end, int parent);
+	void search(int nodeIndex, const float* query, int& closestIndex, float& closestDistance) const;
+	void search(int nodeIndex, const float* query, NearestTiles& nearestTiles) const;
+};
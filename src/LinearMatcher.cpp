@@ -0,0 +1,45 @@
+#include <LinearMatcher.h>
+
+#include <NearestTiles.h>
+
+#include <cassert>
+#include <limits>
+
+void LinearMatcher::build(const float* f, int n, int d)
+{
+	assert(f != nullptr);
+	assert(n > 0);
+	assert(d > 0);
+
+	features = f;
+	numTiles = n;
+	dimension = d;
+}
+
+int LinearMatcher::findNearest(const float* query) const
+{
+	int closestIndex = -1;
+	float closestDistance = std::numeric_limits<float>::max();
+	for (int tileIndex = 0; tileIndex < numTiles; tileIndex++)
+	{
+		const float distance = squaredDistance(query, features + size_t(tileIndex) * dimension, dimension);
+		if (distance < closestDistance)
+		{
+			closestIndex = tileIndex;
+			closestDistance = distance;
+		}
+	}
+	return closestIndex;
+}
+
+int LinearMatcher::findNearest(const float* query, int numNearest, int* nearestTileIndices) const
+{
+	NearestTiles nearestTiles(numNearest);
+	for (int tileIndex = 0; tileIndex < numTiles; tileIndex++)
+	{
+		const float distance = squaredDistance(query, features + size_t(tileIndex) * dimension, dimension);
+		if (distance <= nearestTiles.getWorstDistance())
+			nearestTiles.offer(distance, tileIndex);
+	}
+	return nearestTiles.extract(nearestTileIndices);
+}
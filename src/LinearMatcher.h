@@ -0,0 +1,18 @@
+#pragma once
+
+#include <TileMatcher.h>
+
+// Exhaustive scan over every tile
+class LinearMatcher : public TileMatcher
+{
+public:
+	void build(const float* features, int numTiles, int dimension) override;
+	int findNearest(const float* query) const override;
+	int findNearest(const float* query, int numNearest, int* nearestTileIndices) const override;
+	const char* getName() const override { return "linear"; }
+
+private:
+	const float* features = nullptr;
+	int numTiles = 0;
+	int dimension = 0;
+};
@@ -0,0 +1,51 @@
+#include <MappedFile.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::open(const std::filesystem::path& path)
+{
+	close();
+
+	const int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat fileStat;
+	if (fstat(fd, &fileStat) != 0 || fileStat.st_size <= 0)
+	{
+		::close(fd);
+		return false;
+	}
+
+	const size_t fileSize = size_t(fileStat.st_size);
+	void* address = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (address == MAP_FAILED)
+		return false;
+
+	data = static_cast<unsigned char*>(address);
+	size = fileSize;
+
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (data)
+		munmap(data, size);
+	data = nullptr;
+	size = 0;
+}
+
+bool MappedFile::isValid() const
+{
+	return data != nullptr;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	virtual ~MappedFile();
+
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// Fails for missing and empty files
+	bool open(const std::filesystem::path& path);
+	void close();
+	bool isValid() const;
+	const unsigned char* getData() const { return data; }
+	size_t getSize() const { return size; }
+
+private:
+	unsigned char* data = nullptr;
+	size_t size = 0;
+};
@@ -0,0 +1,84 @@
+#include <MatchCache.h>
+
+#include <TileMatcher.h>
+
+#include <cassert>
+#include <cstring>
+
+#define MATCH_CACHE_MAX_SLOTS (1 << 20)
+// Slots looked at past the first before giving up, which keeps lookups short once the table fills up
+#define MATCH_CACHE_MAX_PROBES 32
+
+MatchCache::MatchCache(int capacity, int d)
+	: dimension(d)
+{
+	assert(capacity > 0 && dimension > 0);
+
+	// At most half full
+	size_t numSlots = 1;
+	while (numSlots < size_t(capacity) * 2 && numSlots < MATCH_CACHE_MAX_SLOTS)
+		numSlots *= 2;
+	slotMask = numSlots - 1;
+	entries = std::vector<Entry>(numSlots);
+}
+
+int MatchCache::find(const float* descriptor) const
+{
+	numLookups.fetch_add(1, std::memory_order_relaxed);
+
+	const uint64_t key = hashDescriptor(descriptor);
+	size_t slot = key & slotMask;
+	for (int probe = 0; probe <= MATCH_CACHE_MAX_PROBES; probe++)
+	{
+		const Entry& entry = entries[slot];
+		const uint64_t entryKey = entry.key.load(std::memory_order_acquire);
+		if (entryKey == 0)
+			break;
+		if (entryKey == key && isSameDescriptor(entry, descriptor))
+		{
+			numHits.fetch_add(1, std::memory_order_relaxed);
+			return entry.tileIndex.load(std::memory_order_relaxed);
+		}
+		slot = (slot + 1) & slotMask;
+	}
+	return -1;
+}
+
+void MatchCache::insert(const float* descriptor, int tileIndex)
+{
+	assert(tileIndex >= 0);
+
+	const uint64_t key = hashDescriptor(descriptor);
+	size_t slot = key & slotMask;
+	for (int probe = 0; probe <= MATCH_CACHE_MAX_PROBES; probe++)
+	{
+		Entry& entry = entries[slot];
+		uint64_t entryKey = 0;
+		if (entry.key.compare_exchange_strong(entryKey, key, std::memory_order_acq_rel))
+		{
+			entry.descriptor = descriptor;
+			entry.tileIndex.store(tileIndex, std::memory_order_release);
+			return;
+		}
+
+		// Another thread may have matched the same descriptor meanwhile
+		if (entryKey == key && isSameDescriptor(entry, descriptor))
+			return;
+		slot = (slot + 1) & slotMask;
+	}
+}
+
+uint64_t MatchCache::hashDescriptor(const float* descriptor) const
+{
+	const uint64_t hash = TileMatcher::hashFeatures(descriptor, dimension);
+	// 0 marks free slots
+	return hash + (hash == 0);
+}
+
+bool MatchCache::isSameDescriptor(const Entry& entry, const float* descriptor) const
+{
+	// Entries still being written are skipped, the descriptor is only set before tileIndex
+	if (entry.tileIndex.load(std::memory_order_acquire) < 0)
+		return false;
+	return std::memcmp(entry.descriptor, descriptor, size_t(dimension) * sizeof(float)) == 0;
+}
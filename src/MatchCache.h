@@ -0,0 +1,41 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Tiles already matched to cell descriptors, shared by concurrent matchers without locks.
+// Descriptors are keyed on a hash of their exact bits and compared bit for bit on a hit,
+// so a cell only gets a cached tile when it looks exactly like one matched before.
+// Entries are never removed; once the table is full new ones are dropped.
+class MatchCache
+{
+public:
+	MatchCache(int capacity, int dimension);
+
+	// Cached tile for the descriptor, or -1
+	int find(const float* descriptor) const;
+	// The descriptor is referenced rather than copied, it must stay unchanged while the cache is used
+	void insert(const float* descriptor, int tileIndex);
+	uint64_t getNumLookups() const { return numLookups.load(std::memory_order_relaxed); }
+	uint64_t getNumHits() const { return numHits.load(std::memory_order_relaxed); }
+
+private:
+	// A slot is claimed by setting key, and readable once tileIndex is set
+	struct Entry
+	{
+		std::atomic<uint64_t> key{0};
+		const float* descriptor = nullptr;
+		std::atomic<int32_t> tileIndex{-1};
+	};
+
+	int dimension = 0;
+	size_t slotMask = 0;
+	std::vector<Entry> entries;
+	mutable std::atomic<uint64_t> numLookups{0};
+	mutable std::atomic<uint64_t> numHits{0};
+
+	uint64_t hashDescriptor(const float* descriptor) const;
+	bool isSameDescriptor(const Entry& entry, const float* descriptor) const;
+};
@@ -1,23 +1,48 @@
 #include <Mosaic.h>
 
+#include <NearestTiles.h>
+#include <Parallel.h>
 #include <Pixel.h>
+#include <SimdMatcher.h>
+#include <TilePipeline.h>
 
+#include <algorithm>
 #include <cassert>
-#include <iterator>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
 #include <limits>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+
+// Cells compared against exhaustive search when checking matches
+#define MATCH_CHECK_MAX_CELLS 4096
+#define MAX_DESCRIPTOR_GRID_SIZE 8
+#define MAX_DESCRIPTOR_DIMENSION (MAX_DESCRIPTOR_GRID_SIZE * MAX_DESCRIPTOR_GRID_SIZE * COLOUR_FEATURE_DIMENSION)
+// Tiles whose descriptors are computed by a task
+#define DESCRIPTOR_TILES_PER_TASK 256
+// Cells matched and drawn by a task, rounded to whole rows
+#define MOSAIC_CELLS_PER_TASK 256
 
 Mosaic::~Mosaic()
 {
-	delete[] tileImages;
+	resetTiles();
 }
 
 void Mosaic::resetTiles()
 {
-	numTileImages = 0;
-	delete[] tileImages;
-	tileImages = nullptr;
+	tileAtlas.reset();
 	delete[] tileMeans;
 	tileMeans = nullptr;
+	descriptorDimension = 0;
+	tileDescriptors.clear();
+	pca.reset();
+	projectedTileDescriptors.clear();
+	delete tileMatcher;
+	tileMatcher = nullptr;
+	colourLut.reset();
 }
 
 bool Mosaic::isValid() const
@@ -25,9 +50,10 @@ bool Mosaic::isValid() const
 	return tileSize > 0 &&
 		sourceImage.isValid() &&
 		meanImage.isValid() &&
-		numTileImages > 0 &&
-		tileImages != nullptr &&
-		tileMeans != nullptr;
+		tileAtlas.isValid() &&
+		tileAtlas.getTileSize() == tileSize &&
+		tileMeans != nullptr &&
+		tileMatcher != nullptr;
 }
 
 void Mosaic::setTileSize(int size)
@@ -36,6 +62,13 @@ void Mosaic::setTileSize(int size)
 	assert(size <= 4096);
 
 	tileSize = size;
+
+	// The atlas is laid out for one tile size, other sizes need the tiles loaded again
+	if (tileAtlas.isValid() && tileAtlas.getTileSize() != tileSize)
+		resetTiles();
+
+	if (sourceImage.isValid())
+		computeCellMeans();
 }
 
 void Mosaic::setScaling(float s)
@@ -44,6 +77,131 @@ void Mosaic::setScaling(float s)
 	assert(s <= 10.0f);
 
 	scaling = s;
+
+	if (sourceImage.isValid() && tileSize > 0)
+		computeCellMeans();
+}
+
+void Mosaic::setNumThreads(int n)
+{
+	assert(n >= 0);
+
+	numThreads = n;
+}
+
+void Mosaic::setTileCachePath(const std::filesystem::path& cachePath)
+{
+	tileCachePath = cachePath;
+}
+
+void Mosaic::setUseExifThumbnails(bool useThumbnails)
+{
+	useExifThumbnails = useThumbnails;
+}
+
+void Mosaic::setUseIoUring(bool useRing)
+{
+	useIoUring = useRing;
+}
+
+void Mosaic::setMatchMode(MatchMode mode)
+{
+	matchMode = mode;
+
+	if (tileMatcher)
+		buildTileMatcher();
+}
+
+void Mosaic::setColourSpace(ColourSpace space)
+{
+	colourSpace = space;
+
+	if (tileMatcher)
+		buildTileMatcher();
+}
+
+void Mosaic::setDescriptorGridSize(int gridSize)
+{
+	assert(gridSize > 0 && gridSize <= MAX_DESCRIPTOR_GRID_SIZE);
+
+	descriptorGridSize = gridSize;
+
+	if (sourceImage.isValid())
+		computeCellMeans();
+	if (tileMatcher)
+		buildTileMatcher();
+}
+
+void Mosaic::setPcaDimension(int dimension)
+{
+	assert(dimension >= 0);
+
+	pcaDimension = dimension;
+
+	if (tileMatcher)
+		buildTileMatcher();
+}
+
+void Mosaic::setIvfParameters(int numLists, int numProbes)
+{
+	assert(numLists >= 0);
+	assert(numProbes > 0);
+
+	ivfNumLists = numLists;
+	ivfNumProbes = numProbes;
+
+	if (tileMatcher && matchMode == MatchMode::Ivf)
+		buildTileMatcher();
+}
+
+void Mosaic::setLutResolution(int resolution)
+{
+	assert(resolution >= 0 && resolution <= 256);
+
+	lutResolution = resolution;
+
+	if (tileMatcher)
+		buildColourLut();
+}
+
+void Mosaic::setRandomPick(int candidates, uint32_t seed)
+{
+	assert(candidates > 0 && candidates <= MAX_NEAREST_TILES);
+
+	numCandidates = candidates;
+	randomSeed = seed;
+
+	if (tileMatcher)
+		buildColourLut();
+}
+
+void Mosaic::setMaxTileUses(int maxUses)
+{
+	assert(maxUses >= 0);
+
+	maxTileUses = maxUses;
+}
+
+void Mosaic::setAssignmentMethod(AssignmentMethod method)
+{
+	assignmentMethod = method;
+}
+
+void Mosaic::setRepeatRadius(int radius)
+{
+	assert(radius >= 0);
+
+	repeatRadius = radius;
+}
+
+void Mosaic::setUseMatchCache(bool useCache)
+{
+	useMatchCache = useCache;
+}
+
+void Mosaic::setCheckMatches(bool check)
+{
+	checkMatches = check;
 }
 
 bool Mosaic::setSourceImage(const std::filesystem::path& imagePath)
@@ -51,7 +209,8 @@ bool Mosaic::setSourceImage(const std::filesystem::path& imagePath)
 	if (!sourceImage.load(imagePath.c_str()) || !sourceImage.isValid())
 		return false;
 
-	sourceImage.computeTileMeans(meanImage, int(tileSize / scaling));
+	sourceSums.build(sourceImage);
+	computeCellMeans();
 
 	return true;
 }
@@ -61,34 +220,71 @@ bool Mosaic::setTilesFolder(const std::filesystem::path& folderPath)
 	if (!std::filesystem::is_directory(folderPath))
 		return false;
 
-	if (tileImages)
-		resetTiles();
+	resetTiles();
+
+	std::vector<TileSourceFile> sourceFiles = getFilesInFolder(folderPath);
+
+	// The cache may live inside the tiles folder, it is never a tile itself
+	if (!tileCachePath.empty())
+	{
+		sourceFiles.erase(std::remove_if(sourceFiles.begin(), sourceFiles.end(),
+			[this](const TileSourceFile& sourceFile)
+			{
+				std::error_code error;
+				return sourceFile.path.filename() == tileCachePath.filename() &&
+					std::filesystem::equivalent(sourceFile.path, tileCachePath, error);
+			}), sourceFiles.end());
+	}
 
-	const int numFiles = getNumFilesInFolder(folderPath);
-	tileImages = new Image[numFiles];
+	const int numFiles = int(sourceFiles.size());
+	// Tiles are stored with the channels of the mosaic, so that they can be copied as is
+	const int tileChannels = sourceImage.isValid() ? sourceImage.getNumChannels() : 4;
+	tileAtlas.init(numFiles, tileSize, tileChannels);
 	tileMeans = new Pixel[numFiles];
 
-	for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(folderPath))
+	// Unchanged files are served from the cache, only the others get decoded
+	std::vector<char> isTileLoaded(numFiles, 0);
+	std::vector<char> isDecodeNeeded(numFiles, 1);
+	int numEntriesReused = 0;
+	int numEntriesEvicted = 0;
+	loadTilesFromCache(sourceFiles, isTileLoaded, isDecodeNeeded, numEntriesReused, numEntriesEvicted);
+
+	const int numEntriesAdded = numFiles - numEntriesReused;
+	loadTilesFromFiles(sourceFiles, isDecodeNeeded, isTileLoaded);
+
+	if (!tileCachePath.empty())
 	{
-		Image sourceImage;
-		if (entry.is_regular_file() && sourceImage.load(entry.path().c_str()))
-		{
-			Image& tileImage = tileImages[numTileImages];
-			sourceImage.cropToSquare(tileImage, tileSize, tileSize);
+		std::cout << "Tile cache '" << tileCachePath.native() << "': reused " << numEntriesReused <<
+			", added " << numEntriesAdded << ", evicted " << numEntriesEvicted << " entries." << std::endl;
+
+		if (numEntriesAdded > 0 || numEntriesEvicted > 0)
+			TileCache::write(tileCachePath, tileAtlas, getTileIngestMode(), sourceFiles, tileMeans, isTileLoaded);
+	}
 
-			Pixel& meanPixel = tileMeans[numTileImages];
-			tileImage.computeTileMean(meanPixel, 0, 0, tileSize);
+	// Compact in file order, which keeps tile indices independent of scheduling
+	int numTiles = 0;
+	for (int fileIndex = 0; fileIndex < numFiles; fileIndex++)
+	{
+		if (!isTileLoaded[fileIndex])
+			continue;
 
-			numTileImages++;
+		if (fileIndex != numTiles)
+		{
+			tileAtlas.moveTile(fileIndex, numTiles);
+			tileMeans[numTiles] = tileMeans[fileIndex];
 		}
+		numTiles++;
 	}
+	tileAtlas.truncate(numTiles);
 
-	if (numTileImages == 0)
+	if (numTiles == 0)
 	{
 		resetTiles();
 		return false;
 	}
 
+	buildTileMatcher();
+
 	return true;
 }
 
@@ -102,47 +298,657 @@ bool Mosaic::makeMosaicImage(Image& mosaicImage) const
 
 	mosaicImage.init(numTilesX * tileSize, numTilesY * tileSize, sourceImage.getNumChannels());
 
-	for (int tileY = 0; tileY < numTilesY; tileY++)
+	const auto startTime = std::chrono::steady_clock::now();
+	const size_t numCells = size_t(numTilesX) * numTilesY;
+	std::vector<float> cellDescriptors(numCells * descriptorDimension);
+	std::vector<int> cellTileIndices(numCells);
+	const bool isRepetitionLimited = repeatRadius > 0 && maxTileUses == 0;
+	if (repeatRadius > 0 && maxTileUses > 0)
+		std::cerr << "Tile repetition is not checked when tile uses are limited." << std::endl;
+	RepetitionWindow repetitionWindow(isRepetitionLimited ? repeatRadius : 1, numTilesX, tileAtlas.getNumTiles());
+	int numRepeatsAvoided = 0;
+	int numExhaustiveSearches = 0;
+	int numRepeatsLeft = 0;
+	const bool isMatchCacheUsed = useMatchCache && numCandidates == 1 && maxTileUses == 0;
+	MatchCache matchCache(isMatchCacheUsed ? int(numCells) : 1, descriptorDimension);
+	MatchCache* cellMatchCache = isMatchCacheUsed ? &matchCache : nullptr;
+	// Bands of rows are matched and drawn independently, each cell into its own part of the
+	// output, so the image does not depend on the number of threads
+	const int rowsPerTask = std::max(1, MOSAIC_CELLS_PER_TASK / numTilesX);
+	const int numTasks = (numTilesY + rowsPerTask - 1) / rowsPerTask;
+
+	// With a repetition radius, a cell depends on the matches of the cells before it, and limited
+	// uses are assigned for all cells at once
+	const bool isMatchedInBands = !isRepetitionLimited && maxTileUses == 0;
+	parallelFor(numTasks, numThreads, [&](int taskIndex)
+	{
+		const int endTileY = std::min(numTilesY, (taskIndex + 1) * rowsPerTask);
+		for (int tileY = taskIndex * rowsPerTask; tileY < endTileY; tileY++)
+		{
+			for (int tileX = 0; tileX < numTilesX; tileX++)
+			{
+				const size_t cellIndex = size_t(tileY) * numTilesX + tileX;
+
+				float* descriptor = &cellDescriptors[cellIndex * descriptorDimension];
+				computeCellDescriptor(tileX, tileY, descriptor);
+				if (isMatchedInBands)
+					cellTileIndices[cellIndex] = matchCell(tileX, tileY, descriptor, cellMatchCache);
+			}
+		}
+	});
+
+	if (isRepetitionLimited)
 	{
-		const int tileStartY = tileY * tileSize;
+		for (int tileY = 0; tileY < numTilesY; tileY++)
+		{
+			for (int tileX = 0; tileX < numTilesX; tileX++)
+			{
+				const size_t cellIndex = size_t(tileY) * numTilesX + tileX;
+				cellTileIndices[cellIndex] = pickUnrepeatedTile(tileX, tileY, &cellDescriptors[cellIndex * descriptorDimension],
+					repetitionWindow, cellMatchCache, numRepeatsAvoided, numExhaustiveSearches, numRepeatsLeft);
+			}
+		}
+	}
+	else if (maxTileUses > 0)
+	{
+		assignLimitedTiles(cellDescriptors, cellTileIndices);
+	}
 
-		for (int tileX = 0; tileX < numTilesX; tileX++)
+	parallelFor(numTasks, numThreads, [&](int taskIndex)
+	{
+		const int endTileY = std::min(numTilesY, (taskIndex + 1) * rowsPerTask);
+		for (int tileY = taskIndex * rowsPerTask; tileY < endTileY; tileY++)
 		{
-			const int tileStartX = tileX * tileSize;
+			for (int tileX = 0; tileX < numTilesX; tileX++)
+			{
+				const int tileIndex = cellTileIndices[size_t(tileY) * numTilesX + tileX];
+				assert(tileIndex >= 0);
+				mosaicImage.replaceTile(tileAtlas.getTileData(tileIndex), tileAtlas.getTileSize(), tileAtlas.getTileSize(),
+					tileAtlas.getNumChannels(), tileX * tileSize, tileY * tileSize);
+			}
+		}
+	});
+
+	const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime);
+	const bool isLutUsed = colourLut.isValid() && maxTileUses == 0;
+	std::cout << "Matched " << numTilesX * numTilesY << " cells against " << tileAtlas.getNumTiles() <<
+		" tiles with the " << (isLutUsed ? "colour lookup table and " : "") << tileMatcher->getName() <<
+		" matcher in " << elapsed.count() << " ms";
+	if (numCandidates > 1 && maxTileUses == 0)
+		std::cout << ", picking among the " << numCandidates << " closest with seed " << randomSeed;
+	std::cout << "." << std::endl;
+	if (isRepetitionLimited)
+	{
+		std::cout << "Kept tiles from repeating within " << repeatRadius << " cells: " << numRepeatsAvoided <<
+			" cells moved off a repeated tile, " << numExhaustiveSearches << " needed an exhaustive search, " <<
+			numRepeatsLeft << " found no tile left to avoid a repeat." << std::endl;
+	}
+	if (matchCache.getNumLookups() > 0)
+	{
+		std::cout << "Match cache answered " << matchCache.getNumHits() << " of " << matchCache.getNumLookups() <<
+			" searches (" << 100.0 * matchCache.getNumHits() / matchCache.getNumLookups() << "%)." << std::endl;
+	}
+
+	if (checkMatches)
+		reportMatchQuality(cellDescriptors, cellTileIndices);
+
+	return true;
+}
+
+void Mosaic::loadTilesFromCache(const std::vector<TileSourceFile>& sourceFiles, std::vector<char>& isTileLoaded,
+	std::vector<char>& isDecodeNeeded, int& numEntriesReused, int& numEntriesEvicted)
+{
+	numEntriesReused = 0;
+	numEntriesEvicted = 0;
+
+	if (tileCachePath.empty())
+		return;
+
+	TileCache tileCache;
+	if (!tileCache.open(tileCachePath))
+		return;
+
+	// Tiles of another size, with other channels or decoded another way cannot be reused
+	if (tileCache.getTileSize() != tileAtlas.getTileSize() || tileCache.getNumChannels() != tileAtlas.getNumChannels() ||
+		tileCache.getIngestMode() != getTileIngestMode())
+	{
+		numEntriesEvicted = tileCache.getNumEntries();
+		return;
+	}
+
+	std::unordered_map<std::string, int> entryIndices;
+	entryIndices.reserve(tileCache.getNumEntries());
+	for (int entryIndex = 0; entryIndex < tileCache.getNumEntries(); entryIndex++)
+		entryIndices[tileCache.getSourceFile(entryIndex).path.native()] = entryIndex;
+
+	for (int fileIndex = 0; fileIndex < int(sourceFiles.size()); fileIndex++)
+	{
+		const TileSourceFile& sourceFile = sourceFiles[fileIndex];
+		const auto entryIt = entryIndices.find(sourceFile.path.native());
+		if (entryIt == entryIndices.end() || tileCache.getSourceFile(entryIt->second) != sourceFile)
+			continue;
+
+		// Entries without a tile record files known to be undecodable
+		if (tileCache.readTile(entryIt->second, tileAtlas, fileIndex, tileMeans[fileIndex]))
+			isTileLoaded[fileIndex] = 1;
+
+		isDecodeNeeded[fileIndex] = 0;
+		numEntriesReused++;
+	}
+
+	numEntriesEvicted = tileCache.getNumEntries() - numEntriesReused;
+}
+
+TileIngestMode Mosaic::getTileIngestMode() const
+{
+	if (Image::canDecodeScaledJpeg())
+		return useExifThumbnails ? TileIngestMode::ExifThumbnailsScaledDecode : TileIngestMode::ScaledDecode;
+	return useExifThumbnails ? TileIngestMode::ExifThumbnails : TileIngestMode::FullDecode;
+}
+
+void Mosaic::loadTilesFromFiles(const std::vector<TileSourceFile>& sourceFiles, const std::vector<char>& isDecodeNeeded,
+	std::vector<char>& isTileLoaded)
+{
+	std::vector<int> fileIndices;
+	for (int fileIndex = 0; fileIndex < int(sourceFiles.size()); fileIndex++)
+	{
+		if (isDecodeNeeded[fileIndex])
+			fileIndices.push_back(fileIndex);
+	}
+
+	TilePipeline pipeline;
+	pipeline.setTileSize(tileAtlas.getTileSize());
+	pipeline.setNumThreads(numThreads);
+	pipeline.setUseExifThumbnails(useExifThumbnails);
+	pipeline.setUseIoUring(useIoUring);
+	pipeline.run(sourceFiles, fileIndices, tileAtlas, tileMeans, isTileLoaded);
+}
+
+void Mosaic::computeCellMeans()
+{
+	sourceSums.computeGridMeans(meanImage, int(tileSize / scaling), descriptorGridSize);
+}
+
+void Mosaic::computeTileDescriptors()
+{
+	const int numTiles = tileAtlas.getNumTiles();
+	const bool withAlpha = hasAlphaInDescriptors();
+	const int colourDimension = withAlpha ? COLOUR_FEATURE_DIMENSION : COLOUR_FEATURE_DIMENSION - 1;
+	descriptorDimension = descriptorGridSize * descriptorGridSize * colourDimension;
+	tileDescriptors.resize(size_t(numTiles) * descriptorDimension);
+
+	// Converted once here and once per cell, never inside the search
+	if (descriptorGridSize == 1)
+	{
+		for (int tileIndex = 0; tileIndex < numTiles; tileIndex++)
+			computeColourFeatures(colourSpace, tileMeans[tileIndex], &tileDescriptors[size_t(tileIndex) * descriptorDimension]);
+		return;
+	}
+
+	// Grids are taken from the atlas, that is from the pixels the mosaic will show
+	const int atlasTileSize = tileAtlas.getTileSize();
+	const int numTasks = (numTiles + DESCRIPTOR_TILES_PER_TASK - 1) / DESCRIPTOR_TILES_PER_TASK;
+	parallelFor(numTasks, numThreads, [&](int taskIndex)
+	{
+		Image tile;
+		tile.init(atlasTileSize, atlasTileSize, tileAtlas.getNumChannels());
 
-			Pixel meanPixel;
-			meanImage.readPixel(meanPixel, tileX, tileY);
+		const int endTileIndex = std::min(numTiles, (taskIndex + 1) * DESCRIPTOR_TILES_PER_TASK);
+		for (int tileIndex = taskIndex * DESCRIPTOR_TILES_PER_TASK; tileIndex < endTileIndex; tileIndex++)
+		{
+			std::memcpy(tile.getData(), tileAtlas.getTileData(tileIndex), size_t(tileAtlas.tileSizeInBytes()));
 
-			int closestMeanIndex = -1;
-			float closestMeanDist = std::numeric_limits<float>::max();
-			for (int tileIndex = 0; tileIndex < numTileImages; tileIndex++)
+			float* descriptor = &tileDescriptors[size_t(tileIndex) * descriptorDimension];
+			for (int gridY = 0; gridY < descriptorGridSize; gridY++)
 			{
-				const Pixel& tileMean = tileMeans[tileIndex];
+				int rectStartY, rectHeight;
+				Image::getGridRect(atlasTileSize, descriptorGridSize, gridY, rectStartY, rectHeight);
 
-				const float meanDist = meanPixel.dist(tileMean);
-				if (meanDist < closestMeanDist)
+				for (int gridX = 0; gridX < descriptorGridSize; gridX++)
 				{
-					closestMeanIndex = tileIndex;
-					closestMeanDist = meanDist;
+					int rectStartX, rectWidth;
+					Image::getGridRect(atlasTileSize, descriptorGridSize, gridX, rectStartX, rectWidth);
+
+					// Tiles smaller than the grid repeat their mean in the empty rectangles
+					Pixel mean;
+					if (!tile.computeRectMean(mean.r, mean.g, mean.b, mean.a, rectStartX, rectStartY, rectWidth, rectHeight))
+						tile.computeTileMean(mean, 0, 0, atlasTileSize);
+
+					computeColourFeatures(colourSpace, mean, descriptor, withAlpha);
+					descriptor += colourDimension;
 				}
 			}
-			assert(closestMeanIndex >= 0);
-			const Image& tile = tileImages[closestMeanIndex];
+		}
+	});
+}
 
-			mosaicImage.replaceTile(tile, tileStartX, tileStartY);
+void Mosaic::computeCellDescriptor(int cellX, int cellY, float* descriptor) const
+{
+	const bool withAlpha = hasAlphaInDescriptors();
+	const int colourDimension = withAlpha ? COLOUR_FEATURE_DIMENSION : COLOUR_FEATURE_DIMENSION - 1;
+	for (int gridY = 0; gridY < descriptorGridSize; gridY++)
+	{
+		for (int gridX = 0; gridX < descriptorGridSize; gridX++)
+		{
+			Pixel mean;
+			meanImage.readPixel(mean, cellX * descriptorGridSize + gridX, cellY * descriptorGridSize + gridY);
+			computeColourFeatures(colourSpace, mean, descriptor, withAlpha);
+			descriptor += colourDimension;
 		}
 	}
+}
 
-	return true;
+bool Mosaic::hasAlphaInDescriptors() const
+{
+	// Single means come from the decoded tiles, which may have alpha even when the mosaic has none
+	const int numChannels = tileAtlas.getNumChannels();
+	return descriptorGridSize == 1 || numChannels == 2 || numChannels == 4;
+}
+
+MatcherSettings Mosaic::getMatcherSettings() const
+{
+	MatcherSettings matcherSettings;
+	matcherSettings.numThreads = numThreads;
+	matcherSettings.ivfNumLists = ivfNumLists;
+	matcherSettings.ivfNumProbes = ivfNumProbes;
+	return matcherSettings;
+}
+
+void Mosaic::buildTileMatcher()
+{
+	const int numTiles = tileAtlas.getNumTiles();
+	computeTileDescriptors();
+
+	pca.reset();
+	projectedTileDescriptors.clear();
+	const float* features = tileDescriptors.data();
+	int featureDimension = descriptorDimension;
+	if (pcaDimension > 0 && pcaDimension < descriptorDimension)
+	{
+		pca.fit(tileDescriptors.data(), numTiles, descriptorDimension, pcaDimension);
+		projectedTileDescriptors.resize(size_t(numTiles) * pcaDimension);
+		for (int tileIndex = 0; tileIndex < numTiles; tileIndex++)
+		{
+			pca.project(&tileDescriptors[size_t(tileIndex) * descriptorDimension],
+				&projectedTileDescriptors[size_t(tileIndex) * pcaDimension]);
+		}
+		features = projectedTileDescriptors.data();
+		featureDimension = pcaDimension;
+	}
+
+	if (descriptorGridSize > 1 || pca.isValid())
+	{
+		std::cout << "Matching " << descriptorGridSize << "x" << descriptorGridSize << " grid descriptors of " <<
+			descriptorDimension << " values";
+		if (pca.isValid())
+			std::cout << ", projected to " << pcaDimension << " keeping " << 100.0 * pca.getExplainedVariance() << "% of the variance";
+		std::cout << "." << std::endl;
+	}
+
+	delete tileMatcher;
+	tileMatcher = TileMatcher::create(matchMode, getMatcherSettings());
+
+	std::filesystem::path indexPath;
+	uint64_t featuresHash = 0;
+	bool isIndexLoaded = false;
+	if (tileMatcher->canBeSaved() && !tileCachePath.empty())
+	{
+		indexPath = tileCachePath;
+		indexPath += std::string(".") + tileMatcher->getName();
+		featuresHash = TileMatcher::hashFeatures(features, size_t(numTiles) * featureDimension);
+		isIndexLoaded = tileMatcher->read(indexPath, features, numTiles, featureDimension, featuresHash);
+		if (isIndexLoaded)
+			std::cout << "Loaded " << tileMatcher->getName() << " index '" << indexPath.native() << "'." << std::endl;
+	}
+
+	if (!isIndexLoaded)
+	{
+		const auto startTime = std::chrono::steady_clock::now();
+		tileMatcher->build(features, numTiles, featureDimension);
+		if (!indexPath.empty())
+		{
+			const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime);
+			std::cout << "Built " << tileMatcher->getName() << " index in " << elapsed.count() << " ms." << std::endl;
+			tileMatcher->write(indexPath, featuresHash);
+		}
+	}
+
+	if (lutResolution > 0)
+		buildColourLut();
+}
+
+void Mosaic::buildColourLut()
+{
+	colourLut.reset();
+	if (lutResolution == 0)
+		return;
+
+	// A single colour only determines the query of single mean descriptors
+	if (descriptorGridSize > 1)
+	{
+		std::cerr << "The colour lookup table only applies to single mean matching, ignoring it." << std::endl;
+		return;
+	}
+
+	if (numCandidates > 1)
+	{
+		std::cerr << "The colour lookup table only holds the closest tile, ignoring it for random picks." << std::endl;
+		return;
+	}
+
+	const int numTiles = tileAtlas.getNumTiles();
+	uint64_t tilesHash = TileMatcher::hashFeatures(tileDescriptors.data(), tileDescriptors.size());
+	if (pca.isValid())
+		tilesHash ^= TileMatcher::hashFeatures(projectedTileDescriptors.data(), projectedTileDescriptors.size());
+	// Approximate searches give other tiles, so the table also depends on how tiles are searched
+	const uint64_t searchParameters[3] = { uint64_t(matchMode), uint64_t(ivfNumLists), uint64_t(ivfNumProbes) };
+	for (const uint64_t parameter : searchParameters)
+		tilesHash = (tilesHash ^ parameter) * 1099511628211ull;
+
+	std::filesystem::path lutPath;
+	if (!tileCachePath.empty())
+	{
+		lutPath = tileCachePath;
+		lutPath += ".lut";
+		if (colourLut.load(lutPath, lutResolution, numTiles, tilesHash))
+		{
+			std::cout << "Loaded colour lookup table '" << lutPath.native() << "', distance increase worst " <<
+				colourLut.getWorstError() << " over exact search at cell corners and middles." << std::endl;
+			return;
+		}
+	}
+
+	const auto startTime = std::chrono::steady_clock::now();
+	// The error is measured against an exhaustive scan, whatever search picks the tiles
+	SimdMatcher exactMatcher;
+	exactMatcher.build(tileDescriptors.data(), numTiles, descriptorDimension);
+	colourLut.build(lutResolution, numTiles, tilesHash, numThreads,
+		[this](const Pixel& colour)
+		{
+			float descriptor[COLOUR_FEATURE_DIMENSION];
+			computeColourFeatures(colourSpace, colour, descriptor);
+			return findNearestTile(descriptor);
+		},
+		[this, &exactMatcher](const Pixel& colour)
+		{
+			float descriptor[COLOUR_FEATURE_DIMENSION];
+			computeColourFeatures(colourSpace, colour, descriptor);
+			return exactMatcher.findNearest(descriptor);
+		},
+		[this](const Pixel& colour, int tileIndex)
+		{
+			float descriptor[COLOUR_FEATURE_DIMENSION];
+			computeColourFeatures(colourSpace, colour, descriptor);
+			const float* tileDescriptor = &tileDescriptors[size_t(tileIndex) * descriptorDimension];
+			return std::sqrt(TileMatcher::squaredDistance(descriptor, tileDescriptor, descriptorDimension));
+		});
+	const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime);
+	std::cout << "Built " << lutResolution << "^3 colour lookup table in " << elapsed.count() << " ms, distance increase worst " <<
+		colourLut.getWorstError() << " over exact search at cell corners and middles." << std::endl;
+
+	if (!lutPath.empty())
+		colourLut.write(lutPath);
+}
+
+int Mosaic::findNearestTile(const float* descriptor) const
+{
+	if (!pca.isValid())
+		return tileMatcher->findNearest(descriptor);
+
+	float projectedDescriptor[MAX_DESCRIPTOR_DIMENSION];
+	pca.project(descriptor, projectedDescriptor);
+	return tileMatcher->findNearest(projectedDescriptor);
+}
+
+int Mosaic::findNearestTiles(const float* descriptor, int numNearest, int* nearestTileIndices) const
+{
+	if (!pca.isValid())
+		return tileMatcher->findNearest(descriptor, numNearest, nearestTileIndices);
+
+	float projectedDescriptor[MAX_DESCRIPTOR_DIMENSION];
+	pca.project(descriptor, projectedDescriptor);
+	return tileMatcher->findNearest(projectedDescriptor, numNearest, nearestTileIndices);
+}
+
+uint64_t Mosaic::hashCell(int cellX, int cellY) const
+{
+	// SplitMix64 finalizer over the seed and coordinates, so that cells can be matched in any order
+	uint64_t hash = ((uint64_t(uint32_t(cellY)) << 32) | uint32_t(cellX)) ^ (uint64_t(randomSeed) * 0x9e3779b97f4a7c15ull);
+	hash += 0x9e3779b97f4a7c15ull;
+	hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ull;
+	hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebull;
+	hash ^= hash >> 31;
+	return hash;
+}
+
+int Mosaic::matchCell(int cellX, int cellY, const float* descriptor, MatchCache* matchCache) const
+{
+	if (numCandidates > 1)
+		return pickTile(cellX, cellY, descriptor);
+
+	// The table only holds opaque colours
+	if (colourLut.isValid())
+	{
+		Pixel meanPixel;
+		meanImage.readPixel(meanPixel, cellX, cellY);
+		if (meanPixel.a == 1.0f)
+			return colourLut.lookup(meanPixel);
+	}
+
+	// Flat areas give many cells with the same descriptor
+	if (matchCache)
+	{
+		const int cachedTileIndex = matchCache->find(descriptor);
+		if (cachedTileIndex >= 0)
+			return cachedTileIndex;
+	}
+	const int tileIndex = findNearestTile(descriptor);
+	if (matchCache)
+		matchCache->insert(descriptor, tileIndex);
+	return tileIndex;
+}
+
+int Mosaic::pickTile(int cellX, int cellY, const float* descriptor) const
+{
+	int nearestTileIndices[MAX_NEAREST_TILES];
+	const int numNearest = findNearestTiles(descriptor, numCandidates, nearestTileIndices);
+	assert(numNearest > 0);
+
+	return nearestTileIndices[hashCell(cellX, cellY) % uint64_t(numNearest)];
+}
+
+int Mosaic::pickUnrepeatedTile(int cellX, int cellY, const float* descriptor, RepetitionWindow& window,
+	MatchCache* matchCache, int& numRepeatsAvoided, int& numExhaustiveSearches, int& numRepeatsLeft) const
+{
+	window.markNeighbours(cellX, cellY);
+
+	// Away from flat areas the closest tile is usually free, and costs a single search
+	int tileIndex = -1;
+	if (numCandidates == 1)
+	{
+		tileIndex = matchCell(cellX, cellY, descriptor, matchCache);
+		if (!window.isAllowed(tileIndex))
+			tileIndex = -1;
+	}
+
+	// Enough candidates to skip every marked tile and still pick among numCandidates, only
+	// very large radii or approximate searches fall back to scanning every tile
+	if (tileIndex < 0)
+	{
+		int nearestTileIndices[MAX_NEAREST_TILES];
+		const int numNearest = findNearestTiles(descriptor,
+			std::min(MAX_NEAREST_TILES, window.getNumMarkedTiles() + numCandidates), nearestTileIndices);
+		assert(numNearest > 0);
+
+		if (!window.isAllowed(nearestTileIndices[0]))
+			numRepeatsAvoided++;
+
+		int numAllowed = 0;
+		for (int nearestIndex = 0; nearestIndex < numNearest && numAllowed < numCandidates; nearestIndex++)
+		{
+			if (window.isAllowed(nearestTileIndices[nearestIndex]))
+				nearestTileIndices[numAllowed++] = nearestTileIndices[nearestIndex];
+		}
+
+		if (numAllowed > 0)
+		{
+			tileIndex = nearestTileIndices[numAllowed > 1 ? hashCell(cellX, cellY) % uint64_t(numAllowed) : 0];
+		}
+		else
+		{
+			numExhaustiveSearches++;
+			tileIndex = findNearestAllowedTile(descriptor, window);
+			if (tileIndex < 0)
+			{
+				numRepeatsLeft++;
+				tileIndex = findNearestTile(descriptor);
+			}
+		}
+	}
+
+	window.setTile(cellX, cellY, tileIndex);
+	return tileIndex;
+}
+
+int Mosaic::findNearestAllowedTile(const float* descriptor, const RepetitionWindow& window) const
+{
+	// Search in the space the matcher was built on
+	const float* query = descriptor;
+	const float* features = tileDescriptors.data();
+	int dimension = descriptorDimension;
+	float projectedDescriptor[MAX_DESCRIPTOR_DIMENSION];
+	if (pca.isValid())
+	{
+		pca.project(descriptor, projectedDescriptor);
+		query = projectedDescriptor;
+		features = projectedTileDescriptors.data();
+		dimension = pcaDimension;
+	}
+
+	int nearestTileIndex = -1;
+	float nearestDistance = 0.0f;
+	for (int tileIndex = 0; tileIndex < tileAtlas.getNumTiles(); tileIndex++)
+	{
+		if (!window.isAllowed(tileIndex))
+			continue;
+		const float distance = TileMatcher::squaredDistance(query, features + size_t(tileIndex) * dimension, dimension);
+		if (nearestTileIndex < 0 || distance < nearestDistance)
+		{
+			nearestDistance = distance;
+			nearestTileIndex = tileIndex;
+		}
+	}
+	return nearestTileIndex;
+}
+
+void Mosaic::assignLimitedTiles(const std::vector<float>& cellDescriptors, std::vector<int>& cellTileIndices) const
+{
+	const int numCells = int(cellTileIndices.size());
+	const int numTiles = tileAtlas.getNumTiles();
+
+	// Search in the space the matcher was built on
+	const float* features = tileDescriptors.data();
+	const float* queries = cellDescriptors.data();
+	int dimension = descriptorDimension;
+	std::vector<float> projectedCellDescriptors;
+	if (pca.isValid())
+	{
+		dimension = pcaDimension;
+		projectedCellDescriptors.resize(size_t(numCells) * dimension);
+		for (int cellIndex = 0; cellIndex < numCells; cellIndex++)
+		{
+			pca.project(&cellDescriptors[size_t(cellIndex) * descriptorDimension],
+				&projectedCellDescriptors[size_t(cellIndex) * dimension]);
+		}
+		features = projectedTileDescriptors.data();
+		queries = projectedCellDescriptors.data();
+	}
+
+	TileAssignment assignment(assignmentMethod, maxTileUses, numThreads);
+	assignment.assign(*tileMatcher, features, numTiles, queries, numCells, dimension, cellTileIndices);
+
+	if (assignment.getMaxUses() > maxTileUses)
+	{
+		std::cerr << "Not enough tiles to use each at most " << maxTileUses << " times, raised the limit to " <<
+			assignment.getMaxUses() << "." << std::endl;
+	}
+	std::cout << "Assigned tiles used at most " << assignment.getMaxUses() << " times each: " <<
+		100.0 * assignment.getNumClosestMatches() / numCells << "% of cells got their closest tile, " <<
+		assignment.getNumFallbackCells() << " fell back past their candidates." << std::endl;
+	if (assignmentMethod == AssignmentMethod::Auction)
+	{
+		std::cout << "Auction ran " << assignment.getNumAuctionPhases() << " phases, " << assignment.getNumAuctionRounds() <<
+			" rounds and " << assignment.getNumAuctionBids() << " bids: total squared distance " <<
+			assignment.getGreedyCost() << " greedy, " << assignment.getAuctionCost() << " after auction, ";
+		if (assignment.hasKeptGreedy())
+			std::cout << "kept the greedy assignment." << std::endl;
+		else
+			std::cout << "at most " << assignment.getOptimalityGap() << " above optimal over the candidates." << std::endl;
+	}
 }
 
-int Mosaic::getNumFilesInFolder(const std::filesystem::path& folderPath)
+void Mosaic::reportMatchQuality(const std::vector<float>& cellDescriptors, const std::vector<int>& cellTileIndices) const
 {
-	return std::count_if(
-		std::filesystem::directory_iterator(folderPath),
-		std::filesystem::directory_iterator{},
-		[](const std::filesystem::directory_entry& entry)
+	// An exhaustive search per cell can take long, look at an even sample of large grids.
+	// Distances are measured between whole descriptors, before any projection.
+	const int numCells = int(cellTileIndices.size());
+	const int cellStep = (numCells + MATCH_CHECK_MAX_CELLS - 1) / MATCH_CHECK_MAX_CELLS;
+	const int numTiles = tileAtlas.getNumTiles();
+
+	int numCellsChecked = 0;
+	int numExactMatches = 0;
+	double worstDistanceIncrease = 0.0;
+	double totalDistanceIncrease = 0.0;
+	for (int cellIndex = 0; cellIndex < numCells; cellIndex += cellStep)
+	{
+		const float* query = &cellDescriptors[size_t(cellIndex) * descriptorDimension];
+
+		float closestDistance = std::numeric_limits<float>::max();
+		for (int tileIndex = 0; tileIndex < numTiles; tileIndex++)
+		{
+			const float* descriptor = &tileDescriptors[size_t(tileIndex) * descriptorDimension];
+			closestDistance = std::min(closestDistance, TileMatcher::squaredDistance(query, descriptor, descriptorDimension));
+		}
+
+		// Equally distant tiles count as exact
+		const float* matchDescriptor = &tileDescriptors[size_t(cellTileIndices[cellIndex]) * descriptorDimension];
+		const float matchDistance = TileMatcher::squaredDistance(query, matchDescriptor, descriptorDimension);
+		if (matchDistance <= closestDistance)
+			numExactMatches++;
+
+		const double distanceIncrease = std::sqrt(double(matchDistance)) - std::sqrt(double(closestDistance));
+		worstDistanceIncrease = std::max(worstDistanceIncrease, distanceIncrease);
+		totalDistanceIncrease += distanceIncrease;
+		numCellsChecked++;
+	}
+
+	std::cout << "Checked " << numCellsChecked << " of " << numCells << " cells against exhaustive search: " <<
+		100.0 * numExactMatches / numCellsChecked << "% exact, distance increase worst " << worstDistanceIncrease <<
+		", mean " << totalDistanceIncrease / numCellsChecked << "." << std::endl;
+}
+
+std::vector<TileSourceFile> Mosaic::getFilesInFolder(const std::filesystem::path& folderPath)
+{
+	std::vector<TileSourceFile> sourceFiles;
+	for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(folderPath))
+	{
+		if (!entry.is_regular_file())
+			continue;
+
+		TileSourceFile sourceFile;
+		sourceFile.path = entry.path();
+		sourceFile.size = entry.file_size();
+		sourceFile.modificationTime = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			entry.last_write_time().time_since_epoch()).count();
+		sourceFiles.push_back(sourceFile);
+	}
+
+	// Directory iteration order is unspecified, sort for reproducible tile indices
+	std::sort(sourceFiles.begin(), sourceFiles.end(),
+		[](const TileSourceFile& a, const TileSourceFile& b)
 		{
-			return entry.is_regular_file();
+			return a.path < b.path;
 		});
+
+	return sourceFiles;
 }
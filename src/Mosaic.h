@@ -1,9 +1,21 @@
 #pragma once
 
+#include <ColourLut.h>
+#include <ColourSpace.h>
+#include <MatchCache.h>
 #include <Image.h>
+#include <IntegralImage.h>
+#include <PcaProjection.h>
+#include <RepetitionWindow.h>
+#include <TileAtlas.h>
+#include <TileAssignment.h>
+#include <TileCache.h>
+#include <TileMatcher.h>
 
+#include <cstdint>
 #include <filesystem>
 #include <map>
+#include <vector>
 
 struct Pixel;
 
@@ -14,8 +26,35 @@ public:
 
 	void resetTiles();
 	bool isValid() const;
+	// Changing the size drops the loaded tiles, setTilesFolder has to be called again
 	void setTileSize(int size);
 	void setScaling(float s);
+	void setNumThreads(int n);
+	void setTileCachePath(const std::filesystem::path& cachePath);
+	void setUseExifThumbnails(bool useThumbnails);
+	void setUseIoUring(bool useRing);
+	void setMatchMode(MatchMode mode);
+	void setColourSpace(ColourSpace space);
+	// Compare the means of a gridSize x gridSize grid of rectangles per tile and per cell
+	void setDescriptorGridSize(int gridSize);
+	// Project descriptors to this many dimensions before searching, 0 to search them whole
+	void setPcaDimension(int dimension);
+	// Clusters of the inverted file index and clusters searched per query, 0 lists to pick from the tiles
+	void setIvfParameters(int numLists, int numProbes);
+	// Cells per axis of the colour lookup table, 0 to search for every cell
+	void setLutResolution(int resolution);
+	// Pick each tile at random among the numCandidates closest, 1 to always take the closest.
+	// The choice only depends on the seed and the cell coordinates.
+	void setRandomPick(int numCandidates, uint32_t seed);
+	// Use every tile at most maxUses times over the whole mosaic, 0 for no limit
+	void setMaxTileUses(int maxUses);
+	// How limited uses are shared out between cells
+	void setAssignmentMethod(AssignmentMethod method);
+	// Never use the same tile twice within radius cells of each other, 0 for no constraint
+	void setRepeatRadius(int radius);
+	// Reuse the match of any earlier cell with the exact same descriptor
+	void setUseMatchCache(bool useCache);
+	void setCheckMatches(bool check);
 	bool setSourceImage(const std::filesystem::path& imagePath);
 	bool setTilesFolder(const std::filesystem::path& folderPath);
 	bool makeMosaicImage(Image& mosaicImage) const;
@@ -23,11 +62,68 @@ public:
 private:
 	int tileSize = 0;
 	float scaling = 1.0f;
+	// Worker threads used for heavy lifting; 0 means one per hardware thread
+	int numThreads = 0;
+	// Tiles are loaded from and saved to this file when set
+	std::filesystem::path tileCachePath;
+	// Build tiles from embedded EXIF thumbnails when they are large enough
+	bool useExifThumbnails = false;
+	// Read tile files through io_uring when the kernel supports it
+	bool useIoUring = true;
 	Image sourceImage;
+	// Built once per source image, cell means at any tile size and scaling are read from it
+	IntegralImage sourceSums;
 	Image meanImage;
-	int numTileImages = 0;
-	Image* tileImages = nullptr;
+	MatchMode matchMode = MatchMode::KdTree;
+	ColourSpace colourSpace = ColourSpace::Rgb;
+	int descriptorGridSize = 1;
+	int pcaDimension = 0;
+	int ivfNumLists = 0;
+	int ivfNumProbes = 8;
+	TileAtlas tileAtlas;
 	Pixel* tileMeans = nullptr;
+	// Tile means in the matching colour space, descriptorDimension floats per tile
+	int descriptorDimension = 0;
+	std::vector<float> tileDescriptors;
+	// When enabled, the matcher searches projected descriptors
+	PcaProjection pca;
+	std::vector<float> projectedTileDescriptors;
+	// Indexes that can be saved are kept next to the tile cache, if any
+	TileMatcher* tileMatcher = nullptr;
+	int lutResolution = 0;
+	// Saved next to the tile cache, if any
+	ColourLut colourLut;
+	int numCandidates = 1;
+	uint32_t randomSeed = 0;
+	int maxTileUses = 0;
+	AssignmentMethod assignmentMethod = AssignmentMethod::Greedy;
+	int repeatRadius = 0;
+	bool useMatchCache = true;
+	// Compare matches with an exhaustive search and report the difference
+	bool checkMatches = false;
 
-	static int getNumFilesInFolder(const std::filesystem::path& folderPath);
+	void loadTilesFromCache(const std::vector<TileSourceFile>& sourceFiles, std::vector<char>& isTileLoaded,
+		std::vector<char>& isDecodeNeeded, int& numEntriesReused, int& numEntriesEvicted);
+	TileIngestMode getTileIngestMode() const;
+	void loadTilesFromFiles(const std::vector<TileSourceFile>& sourceFiles, const std::vector<char>& isDecodeNeeded,
+		std::vector<char>& isTileLoaded);
+	void computeCellMeans();
+	void computeTileDescriptors();
+	void computeCellDescriptor(int cellX, int cellY, float* descriptor) const;
+	bool hasAlphaInDescriptors() const;
+	MatcherSettings getMatcherSettings() const;
+	void buildTileMatcher();
+	void buildColourLut();
+	int findNearestTile(const float* descriptor) const;
+	int findNearestTiles(const float* descriptor, int numNearest, int* nearestTileIndices) const;
+	uint64_t hashCell(int cellX, int cellY) const;
+	int matchCell(int cellX, int cellY, const float* descriptor, MatchCache* matchCache) const;
+	int pickTile(int cellX, int cellY, const float* descriptor) const;
+	int pickUnrepeatedTile(int cellX, int cellY, const float* descriptor, RepetitionWindow& window,
+		MatchCache* matchCache, int& numRepeatsAvoided, int& numExhaustiveSearches, int& numRepeatsLeft) const;
+	int findNearestAllowedTile(const float* descriptor, const RepetitionWindow& window) const;
+	void assignLimitedTiles(const std::vector<float>& cellDescriptors, std::vector<int>& cellTileIndices) const;
+	void reportMatchQuality(const std::vector<float>& cellDescriptors, const std::vector<int>& cellTileIndices) const;
+
+	static std::vector<TileSourceFile> getFilesInFolder(const std::filesystem::path& folderPath);
 };
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <algorithm>
+#include <limits>
+
+// Enough to step over every tile a repetition radius of 22 forbids
+#define MAX_NEAREST_TILES 1024
+
+// Keeps the closest of the tiles it is offered, up to a fixed count, as a max-heap on
+// (distance, tile index). Ties are resolved like TileMatcher::findNearest, by lowest index.
+class NearestTiles
+{
+public:
+	explicit NearestTiles(int capacity)
+		: capacity(std::min(capacity, MAX_NEAREST_TILES))
+	{
+	}
+
+	bool isFull() const { return size == capacity; }
+	// Tiles farther than this cannot be kept anymore
+	float getWorstDistance() const
+	{
+		return isFull() ? candidates[0].distance : std::numeric_limits<float>::infinity();
+	}
+
+	void offer(float distance, int tileIndex)
+	{
+		const Candidate candidate = { distance, tileIndex };
+		if (!isFull())
+		{
+			candidates[size++] = candidate;
+			std::push_heap(candidates, candidates + size);
+		}
+		else if (candidate < candidates[0])
+		{
+			std::pop_heap(candidates, candidates + size);
+			candidates[size - 1] = candidate;
+			std::push_heap(candidates, candidates + size);
+		}
+	}
+
+	// Write the tiles kept from closest to farthest and return their count
+	int extract(int* tileIndices)
+	{
+		std::sort_heap(candidates, candidates + size);
+		for (int candidateIndex = 0; candidateIndex < size; candidateIndex++)
+			tileIndices[candidateIndex] = candidates[candidateIndex].tileIndex;
+		const int count = size;
+		size = 0;
+		return count;
+	}
+
+private:
+	struct Candidate
+	{
+		float distance;
+		int tileIndex;
+
+		bool operator<(const Candidate& other) const
+		{
+			return distance < other.distance || (distance == other.distance && tileIndex < other.tileIndex);
+		}
+	};
+
+	int capacity = 0;
+	int size = 0;
+	Candidate candidates[MAX_NEAREST_TILES];
+};
@@ -0,0 +1,46 @@
+#include <Parallel.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+int getDefaultNumThreads()
+{
+	const int hardwareThreads = int(std::thread::hardware_concurrency());
+	return hardwareThreads > 0 ? hardwareThreads : 1;
+}
+
+void parallelFor(int count, int numThreads, const std::function<void(int)>& task)
+{
+	if (count <= 0)
+		return;
+
+	if (numThreads <= 0)
+		numThreads = getDefaultNumThreads();
+	numThreads = std::min(numThreads, count);
+
+	if (numThreads == 1)
+	{
+		for (int index = 0; index < count; index++)
+			task(index);
+		return;
+	}
+
+	std::atomic<int> nextIndex(0);
+	auto worker = [&]()
+	{
+		for (int index = nextIndex++; index < count; index = nextIndex++)
+			task(index);
+	};
+
+	// The calling thread takes part in the work
+	std::vector<std::thread> threads;
+	threads.reserve(numThreads - 1);
+	for (int threadIndex = 1; threadIndex < numThreads; threadIndex++)
+		threads.emplace_back(worker);
+	worker();
+
+	for (std::thread& thread : threads)
+		thread.join();
+}
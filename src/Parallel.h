@@ -0,0 +1,11 @@
+#pragma once
+
+#include <functional>
+
+// Number of worker threads to use when none is specified
+int getDefaultNumThreads();
+
+// Run task(index) for every index in [0, count), spread over numThreads threads.
+// Indices are handed out dynamically, so tasks of uneven cost balance out.
+// A numThreads of 0 or less selects getDefaultNumThreads().
+void parallelFor(int count, int numThreads, const std::function<void(int)>& task);
@@ -0,0 +1,170 @@
+#include <PcaProjection.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <numeric>
+
+#define PCA_MAX_JACOBI_SWEEPS 64
+
+namespace
+{
+	// Cyclic Jacobi eigenvalue algorithm for a symmetric n x n matrix, destroyed in the
+	// process. Eigenvectors end up in the columns of eigenvectors.
+	void computeEigenvectors(std::vector<double>& matrix, int n, std::vector<double>& eigenvalues,
+		std::vector<double>& eigenvectors)
+	{
+		eigenvectors.assign(size_t(n) * n, 0.0);
+		for (int i = 0; i < n; i++)
+			eigenvectors[size_t(i) * n + i] = 1.0;
+
+		for (int sweep = 0; sweep < PCA_MAX_JACOBI_SWEEPS; sweep++)
+		{
+			double offDiagonal = 0.0;
+			double diagonal = 0.0;
+			for (int i = 0; i < n; i++)
+			{
+				diagonal += matrix[size_t(i) * n + i] * matrix[size_t(i) * n + i];
+				for (int j = i + 1; j < n; j++)
+					offDiagonal += matrix[size_t(i) * n + j] * matrix[size_t(i) * n + j];
+			}
+			if (offDiagonal <= 1e-24 * diagonal || offDiagonal == 0.0)
+				break;
+
+			for (int p = 0; p < n; p++)
+			{
+				for (int q = p + 1; q < n; q++)
+				{
+					const double apq = matrix[size_t(p) * n + q];
+					if (apq == 0.0)
+						continue;
+
+					// Rotation that zeroes element (p, q)
+					const double app = matrix[size_t(p) * n + p];
+					const double aqq = matrix[size_t(q) * n + q];
+					const double theta = (aqq - app) / (2.0 * apq);
+					const double t = (theta >= 0.0 ? 1.0 : -1.0) / (std::fabs(theta) + std::sqrt(theta * theta + 1.0));
+					const double c = 1.0 / std::sqrt(t * t + 1.0);
+					const double s = t * c;
+
+					for (int k = 0; k < n; k++)
+					{
+						const double akp = matrix[size_t(k) * n + p];
+						const double akq = matrix[size_t(k) * n + q];
+						matrix[size_t(k) * n + p] = c * akp - s * akq;
+						matrix[size_t(k) * n + q] = s * akp + c * akq;
+					}
+					for (int k = 0; k < n; k++)
+					{
+						const double apk = matrix[size_t(p) * n + k];
+						const double aqk = matrix[size_t(q) * n + k];
+						matrix[size_t(p) * n + k] = c * apk - s * aqk;
+						matrix[size_t(q) * n + k] = s * apk + c * aqk;
+					}
+					for (int k = 0; k < n; k++)
+					{
+						const double vkp = eigenvectors[size_t(k) * n + p];
+						const double vkq = eigenvectors[size_t(k) * n + q];
+						eigenvectors[size_t(k) * n + p] = c * vkp - s * vkq;
+						eigenvectors[size_t(k) * n + q] = s * vkp + c * vkq;
+					}
+				}
+			}
+		}
+
+		eigenvalues.resize(n);
+		for (int i = 0; i < n; i++)
+			eigenvalues[i] = matrix[size_t(i) * n + i];
+	}
+}
+
+void PcaProjection::fit(const float* vectors, int numVectors, int inDimension, int outDimension)
+{
+	assert(vectors != nullptr);
+	assert(numVectors > 0);
+	assert(outDimension > 0 && outDimension <= inDimension);
+
+	reset();
+
+	const int n = inDimension;
+	std::vector<double> meanSum(n, 0.0);
+	for (int vectorIndex = 0; vectorIndex < numVectors; vectorIndex++)
+	{
+		for (int d = 0; d < n; d++)
+			meanSum[d] += vectors[size_t(vectorIndex) * n + d];
+	}
+	mean.resize(n);
+	for (int d = 0; d < n; d++)
+		mean[d] = float(meanSum[d] / numVectors);
+
+	std::vector<double> covariance(size_t(n) * n, 0.0);
+	std::vector<double> centred(n);
+	for (int vectorIndex = 0; vectorIndex < numVectors; vectorIndex++)
+	{
+		for (int d = 0; d < n; d++)
+			centred[d] = double(vectors[size_t(vectorIndex) * n + d]) - mean[d];
+		for (int i = 0; i < n; i++)
+		{
+			for (int j = i; j < n; j++)
+				covariance[size_t(i) * n + j] += centred[i] * centred[j];
+		}
+	}
+	for (int i = 0; i < n; i++)
+	{
+		for (int j = i; j < n; j++)
+		{
+			covariance[size_t(i) * n + j] /= numVectors;
+			covariance[size_t(j) * n + i] = covariance[size_t(i) * n + j];
+		}
+	}
+
+	std::vector<double> eigenvalues;
+	std::vector<double> eigenvectors;
+	computeEigenvectors(covariance, n, eigenvalues, eigenvectors);
+
+	std::vector<int> order(n);
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(), [&eigenvalues](int a, int b) { return eigenvalues[a] > eigenvalues[b]; });
+
+	const double totalVariance = std::accumulate(eigenvalues.begin(), eigenvalues.end(), 0.0);
+	double keptVariance = 0.0;
+	components.resize(size_t(outDimension) * n);
+	for (int k = 0; k < outDimension; k++)
+	{
+		keptVariance += eigenvalues[order[k]];
+		for (int d = 0; d < n; d++)
+			components[size_t(k) * n + d] = float(eigenvectors[size_t(d) * n + order[k]]);
+	}
+
+	inputDimension = inDimension;
+	outputDimension = outDimension;
+	explainedVariance = totalVariance > 0.0 ? keptVariance / totalVariance : 1.0;
+}
+
+void PcaProjection::reset()
+{
+	inputDimension = 0;
+	outputDimension = 0;
+	mean.clear();
+	components.clear();
+	explainedVariance = 0.0;
+}
+
+bool PcaProjection::isValid() const
+{
+	return outputDimension > 0;
+}
+
+void PcaProjection::project(const float* input, float* output) const
+{
+	assert(isValid());
+
+	for (int k = 0; k < outputDimension; k++)
+	{
+		const float* component = &components[size_t(k) * inputDimension];
+		float value = 0.0f;
+		for (int d = 0; d < inputDimension; d++)
+			value += (input[d] - mean[d]) * component[d];
+		output[k] = value;
+	}
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <vector>
+
+// Principal component analysis of a set of vectors, used to search long descriptors
+// in fewer dimensions. Projected vectors are centred on the mean of the fitted set.
+class PcaProjection
+{
+public:
+	// Find the outputDimension directions of largest variance among numVectors rows of
+	// inputDimension floats
+	void fit(const float* vectors, int numVectors, int inputDimension, int outputDimension);
+	void reset();
+	bool isValid() const;
+	int getInputDimension() const { return inputDimension; }
+	int getOutputDimension() const { return outputDimension; }
+	// Share of the total variance kept by the projection
+	double getExplainedVariance() const { return explainedVariance; }
+	void project(const float* input, float* output) const;
+
+private:
+	int inputDimension = 0;
+	int outputDimension = 0;
+	std::vector<float> mean;
+	// outputDimension rows of inputDimension floats, by decreasing variance
+	std::vector<float> components;
+	double explainedVariance = 0.0;
+};
@@ -0,0 +1,249 @@
+#include <PrunedMatcher.h>
+
+#include <NearestTiles.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+#define PRUNED_MAX_PIVOTS 4
+#define PRUNED_POWER_ITERATIONS 32
+// Lower bounds are computed in double from the same floats, this covers the rounding of
+// float squared distances up to a few hundred dimensions
+#define PRUNED_BOUND_SLACK (1.0 + 1e-4)
+// Components summed between checks of a partial distance
+#define PRUNED_PARTIAL_STEP 4
+
+namespace
+{
+	double euclideanDistance(const float* a, const float* b, int dimension)
+	{
+		double distance = 0.0;
+		for (int d = 0; d < dimension; d++)
+		{
+			const double difference = double(a[d]) - double(b[d]);
+			distance += difference * difference;
+		}
+		return std::sqrt(distance);
+	}
+}
+
+void PrunedMatcher::build(const float* features, int n, int d)
+{
+	assert(features != nullptr);
+	assert(n > 0);
+	assert(d > 0);
+
+	numTiles = n;
+	dimension = d;
+
+	// First principal axis by power iteration on the covariance
+	std::vector<double> mean(dimension, 0.0);
+	for (int tileIndex = 0; tileIndex < numTiles; tileIndex++)
+	{
+		for (int component = 0; component < dimension; component++)
+			mean[component] += features[size_t(tileIndex) * dimension + component];
+	}
+	for (double& value : mean)
+		value /= numTiles;
+
+	axis.assign(dimension, 1.0 / std::sqrt(double(dimension)));
+	std::vector<double> nextAxis(dimension);
+	for (int iteration = 0; iteration < PRUNED_POWER_ITERATIONS; iteration++)
+	{
+		std::fill(nextAxis.begin(), nextAxis.end(), 0.0);
+		for (int tileIndex = 0; tileIndex < numTiles; tileIndex++)
+		{
+			const float* feature = features + size_t(tileIndex) * dimension;
+			double projection = 0.0;
+			for (int component = 0; component < dimension; component++)
+				projection += (feature[component] - mean[component]) * axis[component];
+			for (int component = 0; component < dimension; component++)
+				nextAxis[component] += projection * (feature[component] - mean[component]);
+		}
+		double norm = 0.0;
+		for (const double value : nextAxis)
+			norm += value * value;
+		norm = std::sqrt(norm);
+
+		// All tiles alike, any axis will do
+		if (norm == 0.0)
+			break;
+		for (int component = 0; component < dimension; component++)
+			axis[component] = nextAxis[component] / norm;
+	}
+
+	std::vector<double> tilePositions(numTiles);
+	for (int tileIndex = 0; tileIndex < numTiles; tileIndex++)
+	{
+		const float* feature = features + size_t(tileIndex) * dimension;
+		double position = 0.0;
+		for (int component = 0; component < dimension; component++)
+			position += feature[component] * axis[component];
+		tilePositions[tileIndex] = position;
+	}
+
+	tileIndices.resize(numTiles);
+	std::iota(tileIndices.begin(), tileIndices.end(), 0);
+	std::stable_sort(tileIndices.begin(), tileIndices.end(), [&](int a, int b)
+	{
+		return tilePositions[a] < tilePositions[b];
+	});
+
+	points.resize(size_t(numTiles) * dimension);
+	positions.resize(numTiles);
+	for (int pointIndex = 0; pointIndex < numTiles; pointIndex++)
+	{
+		const int tileIndex = tileIndices[pointIndex];
+		std::copy(features + size_t(tileIndex) * dimension, features + size_t(tileIndex + 1) * dimension,
+			points.begin() + size_t(pointIndex) * dimension);
+		positions[pointIndex] = tilePositions[tileIndex];
+	}
+
+	// Pivots spread out by farthest-point sampling, from the tile farthest from the mean
+	std::vector<float> meanFeature(mean.begin(), mean.end());
+	std::vector<double> closestPivotDistances(numTiles, std::numeric_limits<double>::infinity());
+	int pivotPoint = 0;
+	double farthestDistance = -1.0;
+	for (int pointIndex = 0; pointIndex < numTiles; pointIndex++)
+	{
+		const double distance = euclideanDistance(&points[size_t(pointIndex) * dimension], meanFeature.data(), dimension);
+		if (distance > farthestDistance)
+		{
+			farthestDistance = distance;
+			pivotPoint = pointIndex;
+		}
+	}
+
+	numPivots = std::min(PRUNED_MAX_PIVOTS, numTiles);
+	pivots.resize(size_t(numPivots) * dimension);
+	pivotDistances.resize(size_t(numTiles) * numPivots);
+	for (int pivotIndex = 0; pivotIndex < numPivots; pivotIndex++)
+	{
+		const float* pivot = &points[size_t(pivotPoint) * dimension];
+		std::copy(pivot, pivot + dimension, pivots.begin() + size_t(pivotIndex) * dimension);
+
+		int nextPivotPoint = 0;
+		double nextPivotDistance = -1.0;
+		for (int pointIndex = 0; pointIndex < numTiles; pointIndex++)
+		{
+			const double distance = euclideanDistance(&points[size_t(pointIndex) * dimension], pivot, dimension);
+			pivotDistances[size_t(pointIndex) * numPivots + pivotIndex] = distance;
+			closestPivotDistances[pointIndex] = std::min(closestPivotDistances[pointIndex], distance);
+			if (closestPivotDistances[pointIndex] > nextPivotDistance)
+			{
+				nextPivotDistance = closestPivotDistances[pointIndex];
+				nextPivotPoint = pointIndex;
+			}
+		}
+		pivotPoint = nextPivotPoint;
+	}
+}
+
+int PrunedMatcher::findNearest(const float* query) const
+{
+	double queryPivotDistances[PRUNED_MAX_PIVOTS];
+	const double queryPosition = prepareQuery(query, queryPivotDistances);
+
+	int closestIndex = -1;
+	float closestDistance = std::numeric_limits<float>::max();
+
+	// Visit the side closer along the axis first, until both are out of reach
+	int upper = int(std::lower_bound(positions.begin(), positions.end(), queryPosition) - positions.begin());
+	int lower = upper - 1;
+	while (lower >= 0 || upper < numTiles)
+	{
+		const double lowerGap = lower >= 0 ? queryPosition - positions[lower] : std::numeric_limits<double>::infinity();
+		const double upperGap = upper < numTiles ? positions[upper] - queryPosition : std::numeric_limits<double>::infinity();
+		const bool isLower = lowerGap <= upperGap;
+		const double gap = std::max(0.0, isLower ? lowerGap : upperGap);
+		if (closestIndex >= 0 && gap * gap > closestDistance * PRUNED_BOUND_SLACK)
+			break;
+
+		const int pointIndex = isLower ? lower-- : upper++;
+		if (closestIndex >= 0 && isBoundedOut(pointIndex, queryPivotDistances, closestDistance))
+			continue;
+
+		const float distance = partialSquaredDistance(query, &points[size_t(pointIndex) * dimension], closestDistance);
+		const int tileIndex = tileIndices[pointIndex];
+		if (distance < closestDistance || (distance == closestDistance && tileIndex < closestIndex))
+		{
+			closestIndex = tileIndex;
+			closestDistance = distance;
+		}
+	}
+	return closestIndex;
+}
+
+int PrunedMatcher::findNearest(const float* query, int numNearest, int* nearestTileIndices) const
+{
+	double queryPivotDistances[PRUNED_MAX_PIVOTS];
+	const double queryPosition = prepareQuery(query, queryPivotDistances);
+
+	NearestTiles nearestTiles(numNearest);
+	int upper = int(std::lower_bound(positions.begin(), positions.end(), queryPosition) - positions.begin());
+	int lower = upper - 1;
+	while (lower >= 0 || upper < numTiles)
+	{
+		const double lowerGap = lower >= 0 ? queryPosition - positions[lower] : std::numeric_limits<double>::infinity();
+		const double upperGap = upper < numTiles ? positions[upper] - queryPosition : std::numeric_limits<double>::infinity();
+		const bool isLower = lowerGap <= upperGap;
+		const double gap = std::max(0.0, isLower ? lowerGap : upperGap);
+		const float worstDistance = nearestTiles.getWorstDistance();
+		if (nearestTiles.isFull() && gap * gap > worstDistance * PRUNED_BOUND_SLACK)
+			break;
+
+		const int pointIndex = isLower ? lower-- : upper++;
+		if (nearestTiles.isFull() && isBoundedOut(pointIndex, queryPivotDistances, worstDistance))
+			continue;
+
+		const float distance = partialSquaredDistance(query, &points[size_t(pointIndex) * dimension], worstDistance);
+		if (distance <= worstDistance)
+			nearestTiles.offer(distance, tileIndices[pointIndex]);
+	}
+	return nearestTiles.extract(nearestTileIndices);
+}
+
+double PrunedMatcher::prepareQuery(const float* query, double* queryPivotDistances) const
+{
+	for (int pivotIndex = 0; pivotIndex < numPivots; pivotIndex++)
+		queryPivotDistances[pivotIndex] = euclideanDistance(query, &pivots[size_t(pivotIndex) * dimension], dimension);
+
+	double position = 0.0;
+	for (int component = 0; component < dimension; component++)
+		position += query[component] * axis[component];
+	return position;
+}
+
+bool PrunedMatcher::isBoundedOut(int pointIndex, const double* queryPivotDistances, float bestDistance) const
+{
+	const double* distances = &pivotDistances[size_t(pointIndex) * numPivots];
+	for (int pivotIndex = 0; pivotIndex < numPivots; pivotIndex++)
+	{
+		const double bound = queryPivotDistances[pivotIndex] - distances[pivotIndex];
+		if (bound * bound > bestDistance * PRUNED_BOUND_SLACK)
+			return true;
+	}
+	return false;
+}
+
+float PrunedMatcher::partialSquaredDistance(const float* query, const float* point, float limit) const
+{
+	// Same order of summation as squaredDistance, so that complete sums are identical
+	float distance = 0.0f;
+	int component = 0;
+	while (component < dimension)
+	{
+		const int endComponent = std::min(dimension, component + PRUNED_PARTIAL_STEP);
+		for (; component < endComponent; component++)
+		{
+			const float difference = query[component] - point[component];
+			distance += difference * difference;
+		}
+		if (distance > limit)
+			return distance;
+	}
+	return distance;
+}
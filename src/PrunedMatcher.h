@@ -0,0 +1,43 @@
+#pragma once
+
+#include <TileMatcher.h>
+
+#include <vector>
+
+class NearestTiles;
+
+// Exact scan that skips most tiles without computing their distance. Tiles are sorted
+// along their first principal axis, which is close to luminance for colours, and visited
+// outwards from the query until the gap along the axis alone exceeds the best distance.
+// Tiles on the way are skipped when their distances to a few pivot tiles bound them out
+// by the triangle inequality, and distances are abandoned once their partial sum passes
+// the best one. Bounds carry a small slack for rounding, so that results stay those of
+// a linear scan.
+class PrunedMatcher : public TileMatcher
+{
+public:
+	void build(const float* features, int numTiles, int dimension) override;
+	int findNearest(const float* query) const override;
+	int findNearest(const float* query, int numNearest, int* nearestTileIndices) const override;
+	const char* getName() const override { return "pruned"; }
+
+private:
+	int numTiles = 0;
+	int dimension = 0;
+	int numPivots = 0;
+	std::vector<double> axis;
+	// Features, tile indices and positions along the axis, sorted by position
+	std::vector<float> points;
+	std::vector<int> tileIndices;
+	std::vector<double> positions;
+	std::vector<float> pivots;
+	// numPivots distances to the pivots per point
+	std::vector<double> pivotDistances;
+
+	// Position along the axis and distances to the pivots of a query
+	double prepareQuery(const float* query, double* queryPivotDistances) const;
+	// Whether the point cannot be within bestDistance of the query
+	bool isBoundedOut(int pointIndex, const double* queryPivotDistances, float bestDistance) const;
+	// Stops summing once past limit, and then returns a value above it
+	float partialSquaredDistance(const float* query, const float* point, float limit) const;
+};
@@ -0,0 +1,45 @@
+#include <RepetitionWindow.h>
+
+#include <algorithm>
+#include <cassert>
+
+RepetitionWindow::RepetitionWindow(int r, int cellsX, int numTiles)
+	: radius(r)
+	, numCellsX(cellsX)
+	, rowTileIndices(size_t(r + 1) * cellsX, -1)
+	, tileStamps(numTiles, 0)
+{
+	assert(radius > 0 && numCellsX > 0 && numTiles > 0);
+}
+
+void RepetitionWindow::markNeighbours(int cellX, int cellY)
+{
+	if (++stamp == 0)
+	{
+		std::fill(tileStamps.begin(), tileStamps.end(), 0);
+		stamp = 1;
+	}
+	numMarkedTiles = 0;
+
+	const int startX = std::max(0, cellX - radius);
+	for (int y = std::max(0, cellY - radius); y <= cellY; y++)
+	{
+		// Cells of the current row are only matched up to the left of this one
+		const int endX = y < cellY ? std::min(numCellsX - 1, cellX + radius) : cellX - 1;
+		const int* row = &rowTileIndices[size_t(y % (radius + 1)) * numCellsX];
+		for (int x = startX; x <= endX; x++)
+		{
+			const int tileIndex = row[x];
+			if (tileIndex >= 0 && tileStamps[tileIndex] != stamp)
+			{
+				tileStamps[tileIndex] = stamp;
+				numMarkedTiles++;
+			}
+		}
+	}
+}
+
+void RepetitionWindow::setTile(int cellX, int cellY, int tileIndex)
+{
+	rowTileIndices[size_t(cellY % (radius + 1)) * numCellsX + cellX] = tileIndex;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Tiles matched to the last rows of a grid matched in row-major order, so that a cell can
+// tell which tiles its already matched neighbours within a radius use. Only radius + 1
+// rows are kept, whatever the height of the grid.
+class RepetitionWindow
+{
+public:
+	RepetitionWindow(int radius, int numCellsX, int numTiles);
+
+	// Mark the tiles of the cells within radius of (cellX, cellY) that come before it
+	void markNeighbours(int cellX, int cellY);
+	// Distinct tiles marked for the current cell
+	int getNumMarkedTiles() const { return numMarkedTiles; }
+	bool isAllowed(int tileIndex) const { return tileStamps[tileIndex] != stamp; }
+	void setTile(int cellX, int cellY, int tileIndex);
+
+private:
+	int radius = 0;
+	int numCellsX = 0;
+	// Row y lives in slot y % (radius + 1)
+	std::vector<int> rowTileIndices;
+	// A tile is marked when its stamp matches the current one, which saves clearing them per cell
+	std::vector<uint32_t> tileStamps;
+	uint32_t stamp = 0;
+	int numMarkedTiles = 0;
+};
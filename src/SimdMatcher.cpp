@@ -0,0 +1,261 @@
+#include <SimdMatcher.h>
+
+#include <NearestTiles.h>
+
+#include <cassert>
+#include <cstdlib>
+#include <limits>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MOSAIX_HAS_X86_SIMD
+#include <immintrin.h>
+#endif
+
+// Widest vector, in floats; columns are padded to it and aligned on it
+#define SIMD_MATCHER_LANES 16
+
+namespace
+{
+	int findNearestScalar(const float* columns, int numPaddedTiles, int dimension, const float* query)
+	{
+		int closestIndex = -1;
+		float closestDistance = std::numeric_limits<float>::infinity();
+		for (int tileIndex = 0; tileIndex < numPaddedTiles; tileIndex++)
+		{
+			float distance = 0.0f;
+			for (int d = 0; d < dimension; d++)
+			{
+				const float difference = query[d] - columns[size_t(d) * numPaddedTiles + tileIndex];
+				distance += difference * difference;
+			}
+			if (distance < closestDistance)
+			{
+				closestIndex = tileIndex;
+				closestDistance = distance;
+			}
+		}
+		return closestIndex;
+	}
+
+	void findNearestTilesScalar(const float* columns, int numTiles, int numPaddedTiles, int dimension, const float* query,
+		NearestTiles& nearestTiles)
+	{
+		for (int tileIndex = 0; tileIndex < numTiles; tileIndex++)
+		{
+			float distance = 0.0f;
+			for (int d = 0; d < dimension; d++)
+			{
+				const float difference = query[d] - columns[size_t(d) * numPaddedTiles + tileIndex];
+				distance += difference * difference;
+			}
+			if (distance <= nearestTiles.getWorstDistance())
+				nearestTiles.offer(distance, tileIndex);
+		}
+	}
+
+	// Merge the per-lane results; lanes only ever hold their own earliest best
+	int reduceLanes(const float* distances, const int* indices, int numLanes)
+	{
+		int closestIndex = -1;
+		float closestDistance = std::numeric_limits<float>::infinity();
+		for (int lane = 0; lane < numLanes; lane++)
+		{
+			if (indices[lane] < 0)
+				continue;
+			if (distances[lane] < closestDistance || (distances[lane] == closestDistance && indices[lane] < closestIndex))
+			{
+				closestIndex = indices[lane];
+				closestDistance = distances[lane];
+			}
+		}
+		return closestIndex;
+	}
+
+#ifdef MOSAIX_HAS_X86_SIMD
+	// Offer the tiles of a block whose bit is set in candidateMask, skipping padding
+	void offerBlock(const float* distances, unsigned int candidateMask, int blockStart, int numTiles,
+		NearestTiles& nearestTiles)
+	{
+		while (candidateMask != 0)
+		{
+			const int lane = __builtin_ctz(candidateMask);
+			candidateMask &= candidateMask - 1;
+			const int tileIndex = blockStart + lane;
+			if (tileIndex < numTiles && distances[lane] <= nearestTiles.getWorstDistance())
+				nearestTiles.offer(distances[lane], tileIndex);
+		}
+	}
+
+	// Products and sums stay separate instructions, fusing them would change rounding
+	__attribute__((target("avx2")))
+	int findNearestAvx2(const float* columns, int numPaddedTiles, int dimension, const float* query)
+	{
+		__m256 closestDistances = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+		__m256i closestIndices = _mm256_set1_epi32(-1);
+		__m256i tileIndices = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+		const __m256i indexStep = _mm256_set1_epi32(8);
+
+		for (int tileIndex = 0; tileIndex < numPaddedTiles; tileIndex += 8)
+		{
+			__m256 distances = _mm256_setzero_ps();
+			for (int d = 0; d < dimension; d++)
+			{
+				const __m256 values = _mm256_load_ps(columns + size_t(d) * numPaddedTiles + tileIndex);
+				const __m256 differences = _mm256_sub_ps(_mm256_set1_ps(query[d]), values);
+				distances = _mm256_add_ps(distances, _mm256_mul_ps(differences, differences));
+			}
+
+			const __m256 isCloser = _mm256_cmp_ps(distances, closestDistances, _CMP_LT_OQ);
+			closestDistances = _mm256_blendv_ps(closestDistances, distances, isCloser);
+			closestIndices = _mm256_blendv_epi8(closestIndices, tileIndices, _mm256_castps_si256(isCloser));
+			tileIndices = _mm256_add_epi32(tileIndices, indexStep);
+		}
+
+		alignas(32) float distances[8];
+		alignas(32) int indices[8];
+		_mm256_store_ps(distances, closestDistances);
+		_mm256_store_si256(reinterpret_cast<__m256i*>(indices), closestIndices);
+		return reduceLanes(distances, indices, 8);
+	}
+
+	__attribute__((target("avx2")))
+	void findNearestTilesAvx2(const float* columns, int numTiles, int numPaddedTiles, int dimension, const float* query,
+		NearestTiles& nearestTiles)
+	{
+		alignas(32) float blockDistances[8];
+		for (int tileIndex = 0; tileIndex < numPaddedTiles; tileIndex += 8)
+		{
+			__m256 distances = _mm256_setzero_ps();
+			for (int d = 0; d < dimension; d++)
+			{
+				const __m256 values = _mm256_load_ps(columns + size_t(d) * numPaddedTiles + tileIndex);
+				const __m256 differences = _mm256_sub_ps(_mm256_set1_ps(query[d]), values);
+				distances = _mm256_add_ps(distances, _mm256_mul_ps(differences, differences));
+			}
+
+			const __m256 isCandidate = _mm256_cmp_ps(distances, _mm256_set1_ps(nearestTiles.getWorstDistance()), _CMP_LE_OQ);
+			const unsigned int candidateMask = unsigned(_mm256_movemask_ps(isCandidate));
+			if (candidateMask == 0)
+				continue;
+			_mm256_store_ps(blockDistances, distances);
+			offerBlock(blockDistances, candidateMask, tileIndex, numTiles, nearestTiles);
+		}
+	}
+
+	__attribute__((target("avx512f")))
+	int findNearestAvx512(const float* columns, int numPaddedTiles, int dimension, const float* query)
+	{
+		__m512 closestDistances = _mm512_set1_ps(std::numeric_limits<float>::infinity());
+		__m512i closestIndices = _mm512_set1_epi32(-1);
+		__m512i tileIndices = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+		const __m512i indexStep = _mm512_set1_epi32(16);
+
+		for (int tileIndex = 0; tileIndex < numPaddedTiles; tileIndex += 16)
+		{
+			__m512 distances = _mm512_setzero_ps();
+			for (int d = 0; d < dimension; d++)
+			{
+				const __m512 values = _mm512_load_ps(columns + size_t(d) * numPaddedTiles + tileIndex);
+				const __m512 differences = _mm512_sub_ps(_mm512_set1_ps(query[d]), values);
+				distances = _mm512_add_ps(distances, _mm512_mul_ps(differences, differences));
+			}
+
+			const __mmask16 isCloser = _mm512_cmp_ps_mask(distances, closestDistances, _CMP_LT_OQ);
+			closestDistances = _mm512_mask_blend_ps(isCloser, closestDistances, distances);
+			closestIndices = _mm512_mask_blend_epi32(isCloser, closestIndices, tileIndices);
+			tileIndices = _mm512_add_epi32(tileIndices, indexStep);
+		}
+
+		alignas(64) float distances[16];
+		alignas(64) int indices[16];
+		_mm512_store_ps(distances, closestDistances);
+		_mm512_store_si512(indices, closestIndices);
+		return reduceLanes(distances, indices, 16);
+	}
+
+	__attribute__((target("avx512f")))
+	void findNearestTilesAvx512(const float* columns, int numTiles, int numPaddedTiles, int dimension, const float* query,
+		NearestTiles& nearestTiles)
+	{
+		alignas(64) float blockDistances[16];
+		for (int tileIndex = 0; tileIndex < numPaddedTiles; tileIndex += 16)
+		{
+			__m512 distances = _mm512_setzero_ps();
+			for (int d = 0; d < dimension; d++)
+			{
+				const __m512 values = _mm512_load_ps(columns + size_t(d) * numPaddedTiles + tileIndex);
+				const __m512 differences = _mm512_sub_ps(_mm512_set1_ps(query[d]), values);
+				distances = _mm512_add_ps(distances, _mm512_mul_ps(differences, differences));
+			}
+
+			const __mmask16 isCandidate = _mm512_cmp_ps_mask(distances, _mm512_set1_ps(nearestTiles.getWorstDistance()), _CMP_LE_OQ);
+			if (isCandidate == 0)
+				continue;
+			_mm512_store_ps(blockDistances, distances);
+			offerBlock(blockDistances, isCandidate, tileIndex, numTiles, nearestTiles);
+		}
+	}
+#endif
+}
+
+SimdMatcher::~SimdMatcher()
+{
+	std::free(columns);
+}
+
+void SimdMatcher::build(const float* features, int n, int d)
+{
+	assert(features != nullptr);
+	assert(n > 0);
+	assert(d > 0);
+
+	dimension = d;
+	numTiles = n;
+	numPaddedTiles = (numTiles + SIMD_MATCHER_LANES - 1) / SIMD_MATCHER_LANES * SIMD_MATCHER_LANES;
+
+	std::free(columns);
+	columns = static_cast<float*>(std::aligned_alloc(SIMD_MATCHER_LANES * sizeof(float),
+		size_t(dimension) * numPaddedTiles * sizeof(float)));
+	assert(columns != nullptr);
+	for (int dimensionIndex = 0; dimensionIndex < dimension; dimensionIndex++)
+	{
+		float* column = columns + size_t(dimensionIndex) * numPaddedTiles;
+		for (int tileIndex = 0; tileIndex < numTiles; tileIndex++)
+			column[tileIndex] = features[size_t(tileIndex) * dimension + dimensionIndex];
+		for (int tileIndex = numTiles; tileIndex < numPaddedTiles; tileIndex++)
+			column[tileIndex] = std::numeric_limits<float>::infinity();
+	}
+
+	kernel = findNearestScalar;
+	nearestTilesKernel = findNearestTilesScalar;
+	name = "simd-scalar";
+#ifdef MOSAIX_HAS_X86_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+	{
+		kernel = findNearestAvx512;
+		nearestTilesKernel = findNearestTilesAvx512;
+		name = "simd-avx512";
+	}
+	else if (__builtin_cpu_supports("avx2"))
+	{
+		kernel = findNearestAvx2;
+		nearestTilesKernel = findNearestTilesAvx2;
+		name = "simd-avx2";
+	}
+#endif
+}
+
+int SimdMatcher::findNearest(const float* query) const
+{
+	assert(kernel != nullptr);
+	return kernel(columns, numPaddedTiles, dimension, query);
+}
+
+int SimdMatcher::findNearest(const float* query, int numNearest, int* nearestTileIndices) const
+{
+	assert(nearestTilesKernel != nullptr);
+	NearestTiles nearestTiles(numNearest);
+	nearestTilesKernel(columns, numTiles, numPaddedTiles, dimension, query, nearestTiles);
+	return nearestTiles.extract(nearestTileIndices);
+}
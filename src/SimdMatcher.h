@@ -0,0 +1,41 @@
+#pragma once
+
+#include <TileMatcher.h>
+
+class NearestTiles;
+
+// Exhaustive scan over tile features stored as one aligned array per dimension,
+// evaluating 16 tiles per instruction with AVX-512 or 8 with AVX2. The kernel is
+// picked at runtime from the features of the CPU, with a scalar fallback.
+// Each lane keeps its own best match, updated on strictly smaller distances, and
+// lanes are merged by lowest index among equals, which matches the linear scan.
+// Several nearest tiles are found by offering each block's tiles within the current
+// worst kept distance, which is rarely any once the closest tiles are known.
+class SimdMatcher : public TileMatcher
+{
+public:
+	using Kernel = int (*)(const float* columns, int numPaddedTiles, int dimension, const float* query);
+	using NearestTilesKernel = void (*)(const float* columns, int numTiles, int numPaddedTiles, int dimension,
+		const float* query, NearestTiles& nearestTiles);
+
+	SimdMatcher() = default;
+	SimdMatcher(const SimdMatcher&) = delete;
+	~SimdMatcher() override;
+
+	SimdMatcher& operator=(const SimdMatcher&) = delete;
+
+	void build(const float* features, int numTiles, int dimension) override;
+	int findNearest(const float* query) const override;
+	int findNearest(const float* query, int numNearest, int* nearestTileIndices) const override;
+	const char* getName() const override { return name; }
+
+private:
+	int numTiles = 0;
+	int numPaddedTiles = 0;
+	int dimension = 0;
+	// Column d holds feature d of every tile, padding tiles are infinitely far
+	float* columns = nullptr;
+	Kernel kernel = nullptr;
+	NearestTilesKernel nearestTilesKernel = nullptr;
+	const char* name = "simd";
+};
@@ -0,0 +1,622 @@
+#include <TileAssignment.h>
+
+#include <KdTreeMatcher.h>
+#include <Parallel.h>
+#include <TileMatcher.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+
+// Candidates gathered per cell
+#define TILE_ASSIGNMENT_CANDIDATES 16
+#define TILE_ASSIGNMENT_CELLS_PER_TASK 256
+// The bid increment starts at a quarter of the cost range and is divided by this each phase
+#define AUCTION_EPSILON_DIVISOR 4.0
+// Final bid increment, relative to the cost range
+#define AUCTION_FINAL_EPSILON 1e-7
+
+namespace
+{
+	// Slot prices, with the slots of every tile kept in a binary min-heap on (price, slot). The
+	// cheapest slot of a tile and the price of the next cheapest are then read at once, and a
+	// price change costs O(log slots of the tile). Ties go to the lowest slot, as in a scan.
+	class SlotPrices
+	{
+	public:
+		// Tile t owns the slots from slotStarts[t] up to slotStarts[t + 1]
+		explicit SlotPrices(const std::vector<int>& starts)
+			: slotStarts(starts)
+			, prices(size_t(starts.back()), 0.0)
+			, slotTiles(prices.size())
+			, heapSlots(prices.size())
+			, heapPositions(prices.size())
+		{
+			// Equal prices in slot order already form a heap
+			for (int tileIndex = 0; tileIndex + 1 < int(slotStarts.size()); tileIndex++)
+			{
+				for (int slot = slotStarts[tileIndex]; slot < slotStarts[tileIndex + 1]; slot++)
+				{
+					slotTiles[slot] = tileIndex;
+					heapSlots[slot] = slot;
+					heapPositions[slot] = slot - slotStarts[tileIndex];
+				}
+			}
+		}
+
+		size_t getNumSlots() const { return prices.size(); }
+		int getTile(int slot) const { return slotTiles[slot]; }
+		double get(int slot) const { return prices[slot]; }
+
+		void set(int slot, double price)
+		{
+			const double previousPrice = prices[slot];
+			prices[slot] = price;
+			if (price < previousPrice)
+				siftUp(slot);
+			else
+				siftDown(slot);
+		}
+
+		// Only asked for tiles with edges, which all have slots
+		int getCheapestSlot(int tileIndex, double& secondPrice) const
+		{
+			assert(getNumTileSlots(tileIndex) > 0);
+			const int* heap = &heapSlots[slotStarts[tileIndex]];
+			secondPrice = std::numeric_limits<double>::infinity();
+			for (int position = 1; position <= 2 && position < getNumTileSlots(tileIndex); position++)
+				secondPrice = std::min(secondPrice, prices[heap[position]]);
+			return heap[0];
+		}
+
+	private:
+		std::vector<int> slotStarts;
+		std::vector<double> prices;
+		std::vector<int> slotTiles;
+		// The heap of a tile takes the entries of its own slots
+		std::vector<int> heapSlots;
+		// Position of each slot within the heap of its tile
+		std::vector<int> heapPositions;
+
+		int getNumTileSlots(int tileIndex) const { return slotStarts[tileIndex + 1] - slotStarts[tileIndex]; }
+
+		bool isCheaper(int slot, int otherSlot) const
+		{
+			return prices[slot] < prices[otherSlot] || (prices[slot] == prices[otherSlot] && slot < otherSlot);
+		}
+
+		void moveTo(int* heap, int slot, int position)
+		{
+			heap[position] = slot;
+			heapPositions[slot] = position;
+		}
+
+		void siftUp(int slot)
+		{
+			int* heap = &heapSlots[slotStarts[slotTiles[slot]]];
+			int position = heapPositions[slot];
+			while (position > 0)
+			{
+				const int parentPosition = (position - 1) / 2;
+				if (!isCheaper(slot, heap[parentPosition]))
+					break;
+				moveTo(heap, heap[parentPosition], position);
+				position = parentPosition;
+			}
+			moveTo(heap, slot, position);
+		}
+
+		void siftDown(int slot)
+		{
+			const int numTileSlots = getNumTileSlots(slotTiles[slot]);
+			int* heap = &heapSlots[slotStarts[slotTiles[slot]]];
+			int position = heapPositions[slot];
+			for (;;)
+			{
+				int childPosition = position * 2 + 1;
+				if (childPosition >= numTileSlots)
+					break;
+				if (childPosition + 1 < numTileSlots && isCheaper(heap[childPosition + 1], heap[childPosition]))
+					childPosition++;
+				if (!isCheaper(heap[childPosition], slot))
+					break;
+				moveTo(heap, heap[childPosition], position);
+				position = childPosition;
+			}
+			moveTo(heap, slot, position);
+		}
+	};
+}
+
+bool TileAssignment::Edge::operator<(const Edge& other) const
+{
+	if (distance != other.distance)
+		return distance < other.distance;
+	if (cellIndex != other.cellIndex)
+		return cellIndex < other.cellIndex;
+	return tileIndex < other.tileIndex;
+}
+
+TileAssignment::TileAssignment(AssignmentMethod m, int uses, int threads)
+	: method(m)
+	, maxUses(uses)
+	, numThreads(threads)
+{
+	assert(maxUses > 0);
+}
+
+void TileAssignment::assign(const TileMatcher& matcher, const float* features, int numTiles, const float* queries,
+	int numCells, int dimension, std::vector<int>& cellTileIndices)
+{
+	assert(numTiles > 0);
+
+	if (int64_t(numTiles) * maxUses < numCells)
+		maxUses = (numCells + numTiles - 1) / numTiles;
+
+	std::vector<Edge> candidateEdges;
+	gatherEdges(matcher, features, queries, numCells, dimension, candidateEdges);
+
+	// The first candidate of a cell is its unconstrained match, and the closest one gives its confidence
+	std::vector<Edge> closestEdges(numCells);
+	for (int cellIndex = 0; cellIndex < numCells; cellIndex++)
+		closestEdges[cellIndex] = candidateEdges[size_t(cellIndex) * TILE_ASSIGNMENT_CANDIDATES];
+
+	std::vector<Edge> edges(candidateEdges);
+	edges.erase(std::remove_if(edges.begin(), edges.end(), [](const Edge& edge) { return edge.tileIndex < 0; }),
+		edges.end());
+	std::sort(edges.begin(), edges.end());
+
+	cellTileIndices.assign(numCells, -1);
+	std::vector<int> useCounts(numTiles, 0);
+	for (const Edge& edge : edges)
+	{
+		if (cellTileIndices[edge.cellIndex] >= 0 || useCounts[edge.tileIndex] >= maxUses)
+			continue;
+
+		cellTileIndices[edge.cellIndex] = edge.tileIndex;
+		useCounts[edge.tileIndex]++;
+	}
+
+	std::vector<Edge> fallbackEdges;
+	for (int cellIndex = 0; cellIndex < numCells; cellIndex++)
+	{
+		if (cellTileIndices[cellIndex] < 0)
+			fallbackEdges.push_back(closestEdges[cellIndex]);
+	}
+	numFallbackCells = int(fallbackEdges.size());
+
+	if (!fallbackEdges.empty())
+	{
+		std::sort(fallbackEdges.begin(), fallbackEdges.end());
+
+		// Tiles are dropped from the tree as they run out, and the tree is rebuilt on the
+		// tiles left once half of its tiles are gone, so that searches never wander through
+		// large emptied regions
+		std::vector<int> remainingTileIndices;
+		std::vector<float> remainingFeatures;
+		KdTreeMatcher remainingTiles;
+		int numRemovedTiles = 0;
+		auto rebuild = [&]()
+		{
+			remainingTileIndices.clear();
+			for (int tileIndex = 0; tileIndex < numTiles; tileIndex++)
+			{
+				if (useCounts[tileIndex] < maxUses)
+					remainingTileIndices.push_back(tileIndex);
+			}
+			assert(!remainingTileIndices.empty());
+
+			remainingFeatures.resize(remainingTileIndices.size() * dimension);
+			for (size_t remainingIndex = 0; remainingIndex < remainingTileIndices.size(); remainingIndex++)
+			{
+				const float* feature = features + size_t(remainingTileIndices[remainingIndex]) * dimension;
+				std::copy(feature, feature + dimension, remainingFeatures.begin() + remainingIndex * dimension);
+			}
+			remainingTiles.build(remainingFeatures.data(), int(remainingTileIndices.size()), dimension);
+			numRemovedTiles = 0;
+		};
+		rebuild();
+
+		for (const Edge& edge : fallbackEdges)
+		{
+			const int remainingIndex = remainingTiles.findNearest(queries + size_t(edge.cellIndex) * dimension);
+			assert(remainingIndex >= 0);
+			const int tileIndex = remainingTileIndices[remainingIndex];
+			cellTileIndices[edge.cellIndex] = tileIndex;
+			if (++useCounts[tileIndex] < maxUses)
+				continue;
+
+			remainingTiles.removeTile(remainingIndex);
+			numRemovedTiles++;
+			if (numRemovedTiles * 2 > int(remainingTileIndices.size()) && numRemovedTiles < int(remainingTileIndices.size()))
+				rebuild();
+		}
+	}
+
+	greedyCost = 0.0;
+	for (int cellIndex = 0; cellIndex < numCells; cellIndex++)
+	{
+		const int tileIndex = cellTileIndices[cellIndex];
+		greedyCost += TileMatcher::squaredDistance(queries + size_t(cellIndex) * dimension,
+			features + size_t(tileIndex) * dimension, dimension);
+	}
+	cost = greedyCost;
+	optimalityGap = 0.0;
+	auctionResultCost = 0.0;
+	isGreedyKept = false;
+	numAuctionPhases = 0;
+	numAuctionRounds = 0;
+	numAuctionBids = 0;
+
+	if (method == AssignmentMethod::Auction)
+		runAuction(candidateEdges, features, queries, numTiles, dimension, cellTileIndices);
+
+	numClosestMatches = 0;
+	for (int cellIndex = 0; cellIndex < numCells; cellIndex++)
+	{
+		if (cellTileIndices[cellIndex] == closestEdges[cellIndex].tileIndex)
+			numClosestMatches++;
+	}
+}
+
+bool TileAssignment::parseAssignmentMethod(const std::string& name, AssignmentMethod& method)
+{
+	if (name == "greedy")
+		method = AssignmentMethod::Greedy;
+	else if (name == "auction")
+		method = AssignmentMethod::Auction;
+	else
+		return false;
+	return true;
+}
+
+void TileAssignment::gatherEdges(const TileMatcher& matcher, const float* features, const float* queries, int numCells,
+	int dimension, std::vector<Edge>& edges) const
+{
+	// Candidates of cell i fill slots [i * TILE_ASSIGNMENT_CANDIDATES, (i + 1) * TILE_ASSIGNMENT_CANDIDATES),
+	// closest first, with a negative tile index past the last one found
+	edges.resize(size_t(numCells) * TILE_ASSIGNMENT_CANDIDATES);
+	const int numTasks = (numCells + TILE_ASSIGNMENT_CELLS_PER_TASK - 1) / TILE_ASSIGNMENT_CELLS_PER_TASK;
+	parallelFor(numTasks, numThreads, [&](int taskIndex)
+	{
+		int nearestTileIndices[TILE_ASSIGNMENT_CANDIDATES];
+		const int endCellIndex = std::min(numCells, (taskIndex + 1) * TILE_ASSIGNMENT_CELLS_PER_TASK);
+		for (int cellIndex = taskIndex * TILE_ASSIGNMENT_CELLS_PER_TASK; cellIndex < endCellIndex; cellIndex++)
+		{
+			const float* query = queries + size_t(cellIndex) * dimension;
+			const int numNearest = matcher.findNearest(query, TILE_ASSIGNMENT_CANDIDATES, nearestTileIndices);
+
+			Edge* cellEdges = &edges[size_t(cellIndex) * TILE_ASSIGNMENT_CANDIDATES];
+			for (int candidateIndex = 0; candidateIndex < TILE_ASSIGNMENT_CANDIDATES; candidateIndex++)
+			{
+				Edge& edge = cellEdges[candidateIndex];
+				edge.cellIndex = cellIndex;
+				edge.tileIndex = -1;
+				edge.distance = 0.0f;
+				if (candidateIndex >= numNearest)
+					continue;
+
+				edge.tileIndex = nearestTileIndices[candidateIndex];
+				edge.distance = TileMatcher::squaredDistance(query, features + size_t(edge.tileIndex) * dimension, dimension);
+			}
+		}
+	});
+}
+
+void TileAssignment::runAuction(const std::vector<Edge>& candidateEdges, const float* features, const float* queries,
+	int numTiles, int dimension, std::vector<int>& cellTileIndices)
+{
+	const int numCells = int(cellTileIndices.size());
+	const double infinity = std::numeric_limits<double>::infinity();
+
+	// The greedy tile joins the candidates of its cell, so that a complete assignment always exists
+	std::vector<int> edgeStarts(numCells + 1);
+	std::vector<int> edgeTiles;
+	std::vector<double> edgeCosts;
+	edgeTiles.reserve(candidateEdges.size() + numCells);
+	edgeCosts.reserve(candidateEdges.size() + numCells);
+	double minCost = infinity;
+	double maxCost = 0.0;
+	for (int cellIndex = 0; cellIndex < numCells; cellIndex++)
+	{
+		edgeStarts[cellIndex] = int(edgeTiles.size());
+		bool hasGreedyTile = false;
+		for (int candidateIndex = 0; candidateIndex < TILE_ASSIGNMENT_CANDIDATES; candidateIndex++)
+		{
+			const Edge& edge = candidateEdges[size_t(cellIndex) * TILE_ASSIGNMENT_CANDIDATES + candidateIndex];
+			if (edge.tileIndex < 0)
+				continue;
+			edgeTiles.push_back(edge.tileIndex);
+			edgeCosts.push_back(edge.distance);
+			hasGreedyTile |= edge.tileIndex == cellTileIndices[cellIndex];
+		}
+		if (!hasGreedyTile)
+		{
+			const int tileIndex = cellTileIndices[cellIndex];
+			edgeTiles.push_back(tileIndex);
+			edgeCosts.push_back(TileMatcher::squaredDistance(queries + size_t(cellIndex) * dimension,
+				features + size_t(tileIndex) * dimension, dimension));
+		}
+		for (int edgeIndex = edgeStarts[cellIndex]; edgeIndex < int(edgeTiles.size()); edgeIndex++)
+		{
+			minCost = std::min(minCost, edgeCosts[edgeIndex]);
+			maxCost = std::max(maxCost, edgeCosts[edgeIndex]);
+		}
+	}
+	edgeStarts[numCells] = int(edgeTiles.size());
+
+	const double costRange = maxCost - minCost;
+	if (numCells == 0 || costRange <= 0.0)
+		return;
+
+	// The same edges listed per tile, for the reverse bids of free slots
+	std::vector<int> tileEdgeStarts(numTiles + 1, 0);
+	for (const int tileIndex : edgeTiles)
+		tileEdgeStarts[tileIndex + 1]++;
+	for (int tileIndex = 0; tileIndex < numTiles; tileIndex++)
+		tileEdgeStarts[tileIndex + 1] += tileEdgeStarts[tileIndex];
+	std::vector<int> tileEdgeCells(edgeTiles.size());
+	std::vector<double> tileEdgeCosts(edgeTiles.size());
+	{
+		std::vector<int> tileEdgeEnds(tileEdgeStarts.begin(), tileEdgeStarts.end() - 1);
+		for (int cellIndex = 0; cellIndex < numCells; cellIndex++)
+		{
+			for (int edgeIndex = edgeStarts[cellIndex]; edgeIndex < edgeStarts[cellIndex + 1]; edgeIndex++)
+			{
+				const int tileEdgeIndex = tileEdgeEnds[edgeTiles[edgeIndex]]++;
+				tileEdgeCells[tileEdgeIndex] = cellIndex;
+				tileEdgeCosts[tileEdgeIndex] = edgeCosts[edgeIndex];
+			}
+		}
+	}
+
+	// Every tile offers interchangeable slots, each with its own price. A cell's profit is minus the
+	// cost and price of the slot it holds. No tile can hold more cells than it has edges, which
+	// bounds the slots by the edges however high maxUses is.
+	std::vector<int> slotStarts(numTiles + 1, 0);
+	for (int tileIndex = 0; tileIndex < numTiles; tileIndex++)
+	{
+		const int numTileEdges = tileEdgeStarts[tileIndex + 1] - tileEdgeStarts[tileIndex];
+		slotStarts[tileIndex + 1] = slotStarts[tileIndex] + std::min(maxUses, numTileEdges);
+	}
+	SlotPrices slotPrices(slotStarts);
+	const size_t numSlots = slotPrices.getNumSlots();
+	std::vector<int> slotOwners(numSlots, -1);
+	std::vector<double> slotBids(numSlots, -infinity);
+	std::vector<int> slotBidders(numSlots, -1);
+	std::vector<int> cellSlots(numCells, -1);
+	std::vector<double> cellCosts(numCells, 0.0);
+	std::vector<double> cellProfits(numCells, -infinity);
+	std::vector<int> bidSlots(numCells);
+	std::vector<double> bidPrices(numCells);
+	std::vector<double> bidCosts(numCells);
+	std::vector<int> biddingCells(numCells);
+	for (int cellIndex = 0; cellIndex < numCells; cellIndex++)
+		biddingCells[cellIndex] = cellIndex;
+	std::vector<int> outbidCells;
+	std::vector<int> wonSlots;
+	std::vector<int> freeSlots;
+
+	// Best slot of a cell and the values of its two best options
+	auto findBestSlot = [&](int cellIndex, double& bestValue, double& secondValue, double& bestCost)
+	{
+		bestValue = -infinity;
+		secondValue = -infinity;
+		int bestSlot = -1;
+		for (int edgeIndex = edgeStarts[cellIndex]; edgeIndex < edgeStarts[cellIndex + 1]; edgeIndex++)
+		{
+			double secondPrice = 0.0;
+			const int slot = slotPrices.getCheapestSlot(edgeTiles[edgeIndex], secondPrice);
+			const double value = -edgeCosts[edgeIndex] - slotPrices.get(slot);
+			if (value > bestValue)
+			{
+				secondValue = std::max(bestValue, -edgeCosts[edgeIndex] - secondPrice);
+				bestValue = value;
+				bestSlot = slot;
+				bestCost = edgeCosts[edgeIndex];
+			}
+			else
+			{
+				secondValue = std::max(secondValue, value);
+			}
+		}
+		return bestSlot;
+	};
+
+	auto releaseSlot = [&](int cellIndex)
+	{
+		slotOwners[cellSlots[cellIndex]] = -1;
+		cellSlots[cellIndex] = -1;
+		cellProfits[cellIndex] = -infinity;
+	};
+
+	auto takeSlot = [&](int cellIndex, int slot, double slotCost)
+	{
+		slotOwners[slot] = cellIndex;
+		cellSlots[cellIndex] = slot;
+		cellCosts[cellIndex] = slotCost;
+		cellProfits[cellIndex] = -slotCost - slotPrices.get(slot);
+	};
+
+	double epsilon = costRange / AUCTION_EPSILON_DIVISOR;
+	const double finalEpsilon = costRange * AUCTION_FINAL_EPSILON;
+	double lowestUsedPrice = 0.0;
+	for (;;)
+	{
+		// Forward auction: cells without a slot bid for the one they value most. Bids only
+		// read prices, so they are all placed at once.
+		while (!biddingCells.empty())
+		{
+			const int numBiddingCells = int(biddingCells.size());
+			const int numTasks = (numBiddingCells + TILE_ASSIGNMENT_CELLS_PER_TASK - 1) / TILE_ASSIGNMENT_CELLS_PER_TASK;
+			parallelFor(numTasks, numThreads, [&](int taskIndex)
+			{
+				const int endBiddingIndex = std::min(numBiddingCells, (taskIndex + 1) * TILE_ASSIGNMENT_CELLS_PER_TASK);
+				for (int biddingIndex = taskIndex * TILE_ASSIGNMENT_CELLS_PER_TASK; biddingIndex < endBiddingIndex; biddingIndex++)
+				{
+					const int cellIndex = biddingCells[biddingIndex];
+					double bestValue = 0.0;
+					double secondValue = 0.0;
+					const int bestSlot = findBestSlot(cellIndex, bestValue, secondValue, bidCosts[cellIndex]);
+
+					// A cell with a single option bids as if the next one were the whole cost range away
+					if (secondValue == -infinity)
+						secondValue = bestValue - costRange;
+					bidSlots[cellIndex] = bestSlot;
+					bidPrices[cellIndex] = slotPrices.get(bestSlot) + (bestValue - secondValue) + epsilon;
+				}
+			});
+
+			// Highest bid wins, the earliest cell among equal bids
+			wonSlots.clear();
+			for (const int cellIndex : biddingCells)
+			{
+				const int slot = bidSlots[cellIndex];
+				if (bidPrices[cellIndex] <= slotBids[slot])
+					continue;
+				if (slotBidders[slot] < 0)
+					wonSlots.push_back(slot);
+				slotBids[slot] = bidPrices[cellIndex];
+				slotBidders[slot] = cellIndex;
+			}
+
+			outbidCells.clear();
+			for (const int cellIndex : biddingCells)
+			{
+				if (slotBidders[bidSlots[cellIndex]] != cellIndex)
+					outbidCells.push_back(cellIndex);
+			}
+			for (const int slot : wonSlots)
+			{
+				const int previousOwner = slotOwners[slot];
+				if (previousOwner >= 0)
+				{
+					releaseSlot(previousOwner);
+					outbidCells.push_back(previousOwner);
+				}
+				const int winner = slotBidders[slot];
+				slotPrices.set(slot, slotBids[slot]);
+				takeSlot(winner, slot, bidCosts[winner]);
+				slotBids[slot] = -infinity;
+				slotBidders[slot] = -1;
+			}
+
+			numAuctionRounds++;
+			numAuctionBids += numBiddingCells;
+			biddingCells.swap(outbidCells);
+		}
+
+		// Reverse auction: with more slots than cells, free slots must not be priced above the
+		// cheapest used one, or some cell could be better off on them. A free slot either pulls
+		// over the cell that gains most from it, or drops its price.
+		lowestUsedPrice = infinity;
+		for (int slot = 0; slot < int(numSlots); slot++)
+		{
+			if (slotOwners[slot] >= 0)
+				lowestUsedPrice = std::min(lowestUsedPrice, slotPrices.get(slot));
+		}
+
+		freeSlots.clear();
+		for (int slot = 0; slot < int(numSlots); slot++)
+		{
+			if (slotOwners[slot] < 0 && slotPrices.get(slot) > lowestUsedPrice)
+				freeSlots.push_back(slot);
+		}
+
+		while (!freeSlots.empty())
+		{
+			const int slot = freeSlots.back();
+			freeSlots.pop_back();
+
+			const int tileIndex = slotPrices.getTile(slot);
+			double bestValue = -infinity;
+			double secondValue = -infinity;
+			int bestCell = -1;
+			double bestCost = 0.0;
+			for (int tileEdgeIndex = tileEdgeStarts[tileIndex]; tileEdgeIndex < tileEdgeStarts[tileIndex + 1]; tileEdgeIndex++)
+			{
+				const int cellIndex = tileEdgeCells[tileEdgeIndex];
+				const double value = -tileEdgeCosts[tileEdgeIndex] - cellProfits[cellIndex];
+				if (value > bestValue)
+				{
+					secondValue = bestValue;
+					bestValue = value;
+					bestCell = cellIndex;
+					bestCost = tileEdgeCosts[tileEdgeIndex];
+				}
+				else
+				{
+					secondValue = std::max(secondValue, value);
+				}
+			}
+
+			if (bestCell < 0 || lowestUsedPrice >= bestValue - epsilon)
+			{
+				slotPrices.set(slot, lowestUsedPrice);
+				continue;
+			}
+
+			const int previousSlot = cellSlots[bestCell];
+			releaseSlot(bestCell);
+			if (slotPrices.get(previousSlot) > lowestUsedPrice)
+				freeSlots.push_back(previousSlot);
+			slotPrices.set(slot, std::max(lowestUsedPrice, secondValue - epsilon));
+			takeSlot(bestCell, slot, bestCost);
+			numAuctionBids++;
+		}
+
+		numAuctionPhases++;
+		if (epsilon <= finalEpsilon)
+			break;
+		epsilon = std::max(epsilon / AUCTION_EPSILON_DIVISOR, finalEpsilon);
+
+		// Cells keep their slot into the next phase unless a finer increment shows they would
+		// rather be elsewhere
+		biddingCells.clear();
+		for (int cellIndex = 0; cellIndex < numCells; cellIndex++)
+		{
+			double bestValue = 0.0;
+			double secondValue = 0.0;
+			double bestCost = 0.0;
+			findBestSlot(cellIndex, bestValue, secondValue, bestCost);
+			if (cellProfits[cellIndex] < bestValue - epsilon)
+				biddingCells.push_back(cellIndex);
+		}
+		for (const int cellIndex : biddingCells)
+			releaseSlot(cellIndex);
+	}
+
+	// By weak duality, any non-negative prices bound the optimum from below. Shifting prices
+	// down to the cheapest used one leaves the free slots at no cost.
+	auto getShiftedPrice = [&](int slot) { return std::max(0.0, slotPrices.get(slot) - lowestUsedPrice); };
+
+	double auctionCost = 0.0;
+	double lowerBound = 0.0;
+	for (int cellIndex = 0; cellIndex < numCells; cellIndex++)
+	{
+		auctionCost += cellCosts[cellIndex];
+
+		double cheapestTotal = infinity;
+		for (int edgeIndex = edgeStarts[cellIndex]; edgeIndex < edgeStarts[cellIndex + 1]; edgeIndex++)
+		{
+			double secondPrice = 0.0;
+			const int slot = slotPrices.getCheapestSlot(edgeTiles[edgeIndex], secondPrice);
+			cheapestTotal = std::min(cheapestTotal, edgeCosts[edgeIndex] + getShiftedPrice(slot));
+		}
+		lowerBound += cheapestTotal;
+	}
+	for (int slot = 0; slot < int(numSlots); slot++)
+		lowerBound -= getShiftedPrice(slot);
+
+	// The final increment is small enough for this not to happen in practice
+	auctionResultCost = auctionCost;
+	isGreedyKept = auctionCost > greedyCost;
+	if (isGreedyKept)
+		return;
+
+	for (int cellIndex = 0; cellIndex < numCells; cellIndex++)
+		cellTileIndices[cellIndex] = slotPrices.getTile(cellSlots[cellIndex]);
+	cost = auctionCost;
+	optimalityGap = std::max(0.0, auctionCost - lowerBound);
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class TileMatcher;
+
+enum class AssignmentMethod
+{
+	Greedy,
+	Auction,
+};
+
+// Assigns a tile to every cell so that no tile is used more than maxUses times, while
+// keeping cells close to their best match.
+// The closest tiles of every cell are gathered first, and handed out greedily from the
+// closest pairs overall: cells that match a tile well get it before cells that would
+// barely notice the difference. Cells whose candidates all ran out then take, most
+// confident first, the closest tile with uses left, from a k-d tree that drops tiles
+// as they run out.
+// The auction method then searches for the assignment of least total squared distance
+// over the candidate graph, made of the candidates of every cell and its greedy tile.
+// Cells bid in parallel for the tile uses they value most, and uses go to the highest
+// bidders round after round, with epsilon scaling of the minimum bid increment. When
+// there are more uses than cells, unused ones lower their price or bid for cells in turn.
+class TileAssignment
+{
+public:
+	TileAssignment(AssignmentMethod method, int maxUses, int numThreads);
+
+	// features holds numTiles rows and queries numCells rows of dimension floats, matcher
+	// searches the features and provides the candidates
+	void assign(const TileMatcher& matcher, const float* features, int numTiles, const float* queries, int numCells,
+		int dimension, std::vector<int>& cellTileIndices);
+
+	// Raised when there are too few tiles to cover every cell
+	int getMaxUses() const { return maxUses; }
+	// Cells that got the tile they would have without a limit
+	int getNumClosestMatches() const { return numClosestMatches; }
+	// Cells that none of their candidates was left for
+	int getNumFallbackCells() const { return numFallbackCells; }
+	// Sums of squared distances over all cells
+	double getGreedyCost() const { return greedyCost; }
+	double getCost() const { return cost; }
+	// Total the auction reached, kept only if not above the greedy one
+	double getAuctionCost() const { return auctionResultCost; }
+	bool hasKeptGreedy() const { return isGreedyKept; }
+	// Bound on how much the total could still decrease over the candidate graph, from the final prices
+	double getOptimalityGap() const { return optimalityGap; }
+	int getNumAuctionPhases() const { return numAuctionPhases; }
+	int getNumAuctionRounds() const { return numAuctionRounds; }
+	int64_t getNumAuctionBids() const { return numAuctionBids; }
+
+	static bool parseAssignmentMethod(const std::string& name, AssignmentMethod& method);
+
+private:
+	struct Edge
+	{
+		float distance;
+		int cellIndex;
+		int tileIndex;
+
+		bool operator<(const Edge& other) const;
+	};
+
+	AssignmentMethod method;
+	int maxUses = 0;
+	int numThreads = 0;
+	int numClosestMatches = 0;
+	int numFallbackCells = 0;
+	double greedyCost = 0.0;
+	double cost = 0.0;
+	double optimalityGap = 0.0;
+	double auctionResultCost = 0.0;
+	bool isGreedyKept = false;
+	int numAuctionPhases = 0;
+	int numAuctionRounds = 0;
+	int64_t numAuctionBids = 0;
+
+	void gatherEdges(const TileMatcher& matcher, const float* features, const float* queries, int numCells,
+		int dimension, std::vector<Edge>& edges) const;
+	void runAuction(const std::vector<Edge>& candidateEdges, const float* features, const float* queries, int numTiles,
+		int dimension, std::vector<int>& cellTileIndices);
+};
@@ -0,0 +1,101 @@
+#include <TileAtlas.h>
+
+#include <Image.h>
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+#define TILE_ATLAS_ALIGNMENT 64
+
+namespace
+{
+	size_t alignSize(size_t size)
+	{
+		return (size + TILE_ATLAS_ALIGNMENT - 1) / TILE_ATLAS_ALIGNMENT * TILE_ATLAS_ALIGNMENT;
+	}
+
+	unsigned char* allocateSlab(int numTiles, size_t tileStride)
+	{
+		// aligned_alloc wants a multiple of the alignment, which the stride already is
+		const size_t size = size_t(numTiles) * tileStride;
+		return static_cast<unsigned char*>(std::aligned_alloc(TILE_ATLAS_ALIGNMENT, size > 0 ? size : TILE_ATLAS_ALIGNMENT));
+	}
+}
+
+TileAtlas::~TileAtlas()
+{
+	reset();
+}
+
+void TileAtlas::init(int n, int size, int nChannels)
+{
+	assert(n >= 0);
+	assert(size > 0);
+	assert(nChannels > 0 && nChannels <= 4);
+
+	reset();
+
+	numTiles = n;
+	tileSize = size;
+	channels = nChannels;
+	tileStride = alignSize(size_t(tileSizeInBytes()));
+	data = allocateSlab(numTiles, tileStride);
+	assert(data != nullptr);
+}
+
+void TileAtlas::reset()
+{
+	numTiles = 0;
+	tileSize = 0;
+	channels = 0;
+	tileStride = 0;
+	std::free(data);
+	data = nullptr;
+}
+
+bool TileAtlas::isValid() const
+{
+	return data != nullptr && numTiles > 0;
+}
+
+unsigned char* TileAtlas::getTileData(int tileId)
+{
+	assert(tileId >= 0 && tileId < numTiles);
+	return data + size_t(tileId) * tileStride;
+}
+
+const unsigned char* TileAtlas::getTileData(int tileId) const
+{
+	assert(tileId >= 0 && tileId < numTiles);
+	return data + size_t(tileId) * tileStride;
+}
+
+void TileAtlas::setTile(int tileId, const Image& tile)
+{
+	assert(tile.getWidth() == tileSize);
+	assert(tile.getHeight() == tileSize);
+
+	Image::convertPixels(tile.getData(), tile.getNumChannels(), getTileData(tileId), channels, tileSize * tileSize);
+}
+
+void TileAtlas::moveTile(int fromTileId, int toTileId)
+{
+	if (fromTileId != toTileId)
+		std::memcpy(getTileData(toTileId), getTileData(fromTileId), size_t(tileSizeInBytes()));
+}
+
+void TileAtlas::truncate(int n)
+{
+	assert(n >= 0 && n <= numTiles);
+
+	if (n == numTiles)
+		return;
+
+	unsigned char* newData = allocateSlab(n, tileStride);
+	assert(newData != nullptr);
+	std::memcpy(newData, data, size_t(n) * tileStride);
+	std::free(data);
+	data = newData;
+	numTiles = n;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+
+class Image;
+
+// Pixels of a whole tile library in one aligned slab. Every tile is square, has the
+// same number of channels and starts on a cache line, so tile ids map to addresses
+// with a single multiplication.
+class TileAtlas
+{
+public:
+	TileAtlas() = default;
+	TileAtlas(const TileAtlas&) = delete;
+	virtual ~TileAtlas();
+
+	TileAtlas& operator=(const TileAtlas&) = delete;
+
+	void init(int numTiles, int tileSize, int nChannels);
+	void reset();
+	bool isValid() const;
+	int getNumTiles() const { return numTiles; }
+	int getTileSize() const { return tileSize; }
+	int getNumChannels() const { return channels; }
+	int tileSizeInBytes() const { return tileSize * tileSize * channels; }
+	unsigned char* getTileData(int tileId);
+	const unsigned char* getTileData(int tileId) const;
+	// Copy a tileSize x tileSize image into a slot, converting it to the atlas channels
+	void setTile(int tileId, const Image& tile);
+	void moveTile(int fromTileId, int toTileId);
+	// Keep the first n tiles and give the rest of the slab back
+	void truncate(int n);
+
+private:
+	int numTiles = 0;
+	int tileSize = 0;
+	int channels = 0;
+	size_t tileStride = 0;
+	unsigned char* data = nullptr;
+};
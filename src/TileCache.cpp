@@ -0,0 +1,301 @@
+#include <TileCache.h>
+
+#include <Pixel.h>
+#include <TileAtlas.h>
+
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <system_error>
+
+#define TILE_CACHE_VERSION 4
+// Tile pixels start on a cache line boundary
+#define TILE_CACHE_PIXELS_ALIGNMENT 64
+
+static const char tileCacheMagic[4] = { 'M', 'S', 'X', 'C' };
+
+struct TileCache::FileHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t tileSize;
+	// Every tile has the channels of the atlas it was written from
+	uint32_t channels;
+	uint32_t numEntries;
+	// TileIngestMode of every tile
+	uint32_t ingestMode;
+	uint64_t stringsOffset;
+	uint64_t pixelsOffset;
+};
+
+struct TileCache::FileEntry
+{
+	uint64_t sourceSize;
+	int64_t sourceModificationTime;
+	uint64_t pixelOffset;
+	uint32_t pathOffset;
+	uint32_t pathLength;
+	// Zero if the source file could not be decoded
+	uint32_t channels;
+	uint32_t padding;
+	float mean[4];
+};
+
+bool TileSourceFile::operator==(const TileSourceFile& other) const
+{
+	return size == other.size &&
+		modificationTime == other.modificationTime &&
+		path == other.path;
+}
+
+TileCache::~TileCache()
+{
+	close();
+}
+
+bool TileCache::open(const std::filesystem::path& cachePath)
+{
+	close();
+
+	if (!mapping.open(cachePath))
+		return false;
+
+	if (mapping.getSize() < sizeof(FileHeader))
+	{
+		close();
+		return false;
+	}
+
+	const FileHeader& header = getHeader();
+	if (std::memcmp(header.magic, tileCacheMagic, sizeof(tileCacheMagic)) != 0 ||
+		header.version != TILE_CACHE_VERSION)
+	{
+		std::cerr << "Ignoring tile cache '" << cachePath.native() << "' with unknown format." << std::endl;
+		close();
+		return false;
+	}
+
+	if (!checkBounds())
+	{
+		std::cerr << "Ignoring corrupt tile cache '" << cachePath.native() << "'." << std::endl;
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+void TileCache::close()
+{
+	mapping.close();
+}
+
+bool TileCache::isValid() const
+{
+	return mapping.isValid();
+}
+
+int TileCache::getTileSize() const
+{
+	assert(isValid());
+	return int(getHeader().tileSize);
+}
+
+int TileCache::getNumChannels() const
+{
+	assert(isValid());
+	return int(getHeader().channels);
+}
+
+TileIngestMode TileCache::getIngestMode() const
+{
+	assert(isValid());
+	return TileIngestMode(getHeader().ingestMode);
+}
+
+int TileCache::getNumEntries() const
+{
+	assert(isValid());
+	return int(getHeader().numEntries);
+}
+
+TileSourceFile TileCache::getSourceFile(int entryIndex) const
+{
+	const FileEntry& entry = getEntry(entryIndex);
+	const char* strings = reinterpret_cast<const char*>(mapping.getData() + getHeader().stringsOffset);
+
+	TileSourceFile sourceFile;
+	sourceFile.path = std::string(strings + entry.pathOffset, entry.pathLength);
+	sourceFile.size = entry.sourceSize;
+	sourceFile.modificationTime = entry.sourceModificationTime;
+	return sourceFile;
+}
+
+bool TileCache::hasTile(int entryIndex) const
+{
+	return getEntry(entryIndex).channels > 0;
+}
+
+bool TileCache::readTile(int entryIndex, TileAtlas& atlas, int tileId, Pixel& tileMean) const
+{
+	assert(atlas.getTileSize() == getTileSize());
+	assert(atlas.getNumChannels() == getNumChannels());
+
+	const FileEntry& entry = getEntry(entryIndex);
+	if (entry.channels == 0)
+		return false;
+
+	std::memcpy(atlas.getTileData(tileId), mapping.getData() + entry.pixelOffset, size_t(atlas.tileSizeInBytes()));
+
+	tileMean.r = entry.mean[0];
+	tileMean.g = entry.mean[1];
+	tileMean.b = entry.mean[2];
+	tileMean.a = entry.mean[3];
+
+	return true;
+}
+
+bool TileCache::write(const std::filesystem::path& cachePath, const TileAtlas& atlas, TileIngestMode ingestMode,
+	const std::vector<TileSourceFile>& sourceFiles, const Pixel* means,
+	const std::vector<char>& isTileLoaded)
+{
+	assert(atlas.getNumTiles() >= int(sourceFiles.size()));
+	assert(isTileLoaded.size() == sourceFiles.size());
+
+	const uint32_t numEntries = uint32_t(sourceFiles.size());
+
+	FileHeader header = {};
+	std::memcpy(header.magic, tileCacheMagic, sizeof(tileCacheMagic));
+	header.version = TILE_CACHE_VERSION;
+	header.tileSize = uint32_t(atlas.getTileSize());
+	header.channels = uint32_t(atlas.getNumChannels());
+	header.numEntries = numEntries;
+	header.ingestMode = uint32_t(ingestMode);
+	header.stringsOffset = sizeof(FileHeader) + uint64_t(numEntries) * sizeof(FileEntry);
+
+	std::vector<FileEntry> entries(numEntries);
+	std::string strings;
+	for (uint32_t entryIndex = 0; entryIndex < numEntries; entryIndex++)
+	{
+		const std::string& path = sourceFiles[entryIndex].path.native();
+		FileEntry& entry = entries[entryIndex];
+		entry.sourceSize = sourceFiles[entryIndex].size;
+		entry.sourceModificationTime = sourceFiles[entryIndex].modificationTime;
+		entry.pathOffset = uint32_t(strings.size());
+		entry.pathLength = uint32_t(path.size());
+		strings += path;
+	}
+
+	const uint64_t stringsEnd = header.stringsOffset + strings.size();
+	header.pixelsOffset = (stringsEnd + TILE_CACHE_PIXELS_ALIGNMENT - 1) /
+		TILE_CACHE_PIXELS_ALIGNMENT * TILE_CACHE_PIXELS_ALIGNMENT;
+
+	uint64_t pixelOffset = header.pixelsOffset;
+	for (uint32_t entryIndex = 0; entryIndex < numEntries; entryIndex++)
+	{
+		if (!isTileLoaded[entryIndex])
+			continue;
+
+		FileEntry& entry = entries[entryIndex];
+		entry.channels = header.channels;
+		entry.pixelOffset = pixelOffset;
+		entry.mean[0] = means[entryIndex].r;
+		entry.mean[1] = means[entryIndex].g;
+		entry.mean[2] = means[entryIndex].b;
+		entry.mean[3] = means[entryIndex].a;
+		pixelOffset += uint64_t(atlas.tileSizeInBytes());
+	}
+
+	// Write next to the destination and rename over it once complete
+	std::filesystem::path tempPath(cachePath);
+	tempPath += ".tmp";
+
+	std::ofstream file(tempPath, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+	{
+		std::cerr << "Could not open file " << tempPath.native() << " for writing." << std::endl;
+		return false;
+	}
+
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(entries.data()), std::streamsize(entries.size() * sizeof(FileEntry)));
+	file.write(strings.data(), std::streamsize(strings.size()));
+	const std::string padding(header.pixelsOffset - stringsEnd, '\0');
+	file.write(padding.data(), std::streamsize(padding.size()));
+	for (uint32_t entryIndex = 0; entryIndex < numEntries; entryIndex++)
+	{
+		if (!isTileLoaded[entryIndex])
+			continue;
+
+		file.write(reinterpret_cast<const char*>(atlas.getTileData(int(entryIndex))), atlas.tileSizeInBytes());
+	}
+	file.close();
+
+	std::error_code error;
+	if (file)
+		std::filesystem::rename(tempPath, cachePath, error);
+	if (!file || error)
+	{
+		std::cerr << "Could not write tile cache '" << cachePath.native() << "'." << std::endl;
+		std::filesystem::remove(tempPath, error);
+		return false;
+	}
+
+	std::cout << "Successfully wrote tile cache '" << cachePath.native() << "' with " <<
+		numEntries << " entries." << std::endl;
+
+	return true;
+}
+
+const TileCache::FileHeader& TileCache::getHeader() const
+{
+	assert(mapping.isValid());
+	return *reinterpret_cast<const FileHeader*>(mapping.getData());
+}
+
+const TileCache::FileEntry& TileCache::getEntry(int entryIndex) const
+{
+	assert(entryIndex >= 0);
+	assert(entryIndex < getNumEntries());
+	return reinterpret_cast<const FileEntry*>(mapping.getData() + sizeof(FileHeader))[entryIndex];
+}
+
+bool TileCache::checkBounds() const
+{
+	const FileHeader& header = getHeader();
+	if (header.tileSize == 0 || header.tileSize > 4096 ||
+		header.channels == 0 || header.channels > 4)
+		return false;
+
+	const uint64_t entriesEnd = sizeof(FileHeader) + uint64_t(header.numEntries) * sizeof(FileEntry);
+	if (header.stringsOffset != entriesEnd ||
+		header.pixelsOffset < header.stringsOffset ||
+		header.pixelsOffset > mapping.getSize())
+		return false;
+
+	const uint64_t fileSize = mapping.getSize();
+	const uint64_t stringsSize = header.pixelsOffset - header.stringsOffset;
+	// At most 4096 x 4096 pixels of 4 channels, so this cannot overflow
+	const uint64_t tileBytes = uint64_t(header.tileSize) * header.tileSize * header.channels;
+	for (int entryIndex = 0; entryIndex < int(header.numEntries); entryIndex++)
+	{
+		const FileEntry& entry = getEntry(entryIndex);
+		if (uint64_t(entry.pathOffset) + entry.pathLength > stringsSize)
+			return false;
+
+		if (entry.channels == 0)
+			continue;
+
+		// Offsets come from the file and may be anything, so compare each part with the file
+		// size rather than their sum
+		if (entry.channels != header.channels ||
+			entry.pixelOffset < header.pixelsOffset ||
+			entry.pixelOffset > fileSize ||
+			tileBytes > fileSize - entry.pixelOffset)
+			return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <MappedFile.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+class TileAtlas;
+struct Pixel;
+
+// Identifies the state of a file that tiles were built from
+struct TileSourceFile
+{
+	std::filesystem::path path;
+	uint64_t size = 0;
+	int64_t modificationTime = 0;
+
+	bool operator==(const TileSourceFile& other) const;
+	bool operator!=(const TileSourceFile& other) const { return !(*this == other); }
+};
+
+// How tile pixels were obtained from their source files. The modes give different
+// pixels, so a cache only serves the mode it was written with.
+enum class TileIngestMode : uint32_t
+{
+	FullDecode,
+	// JPEGs decoded at reduced DCT scale
+	ScaledDecode,
+	// Embedded EXIF thumbnails where large enough, full decodes otherwise
+	ExifThumbnails,
+	// Embedded EXIF thumbnails where large enough, scaled decodes otherwise
+	ExifThumbnailsScaledDecode
+};
+
+// Versioned binary file holding cropped tile pixels and their means, one entry per
+// source file. Files that failed to decode are kept in the manifest without pixels,
+// so that they are not retried on every run.
+// Layout, in native byte order:
+//   FileHeader | FileEntry[numEntries] | path strings | padding | tile pixels
+class TileCache
+{
+public:
+	TileCache() = default;
+	TileCache(const TileCache&) = delete;
+	virtual ~TileCache();
+
+	TileCache& operator=(const TileCache&) = delete;
+
+	// Memory-map an existing cache file, checking its header and bounds
+	bool open(const std::filesystem::path& cachePath);
+	void close();
+	bool isValid() const;
+	int getTileSize() const;
+	int getNumChannels() const;
+	TileIngestMode getIngestMode() const;
+	int getNumEntries() const;
+	TileSourceFile getSourceFile(int entryIndex) const;
+	bool hasTile(int entryIndex) const;
+	// Copy the tile of an entry into an atlas slot and tileMean; false if the entry has no tile.
+	// The atlas must have the tile size and channels of the cache.
+	bool readTile(int entryIndex, TileAtlas& atlas, int tileId, Pixel& tileMean) const;
+
+	// Write tile i of the atlas and means[i] for every sourceFiles[i] for which isTileLoaded[i]
+	// is set. The file is replaced atomically, so it is safe to overwrite a cache that is still open.
+	static bool write(const std::filesystem::path& cachePath, const TileAtlas& atlas, TileIngestMode ingestMode,
+		const std::vector<TileSourceFile>& sourceFiles, const Pixel* means,
+		const std::vector<char>& isTileLoaded);
+
+private:
+	struct FileHeader;
+	struct FileEntry;
+
+	MappedFile mapping;
+
+	const FileHeader& getHeader() const;
+	const FileEntry& getEntry(int entryIndex) const;
+	bool checkBounds() const;
+};
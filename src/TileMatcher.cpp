@@ -0,0 +1,55 @@
+#include <TileMatcher.h>
+
+#include <IvfMatcher.h>
+#include <KdTreeMatcher.h>
+#include <LinearMatcher.h>
+#include <PrunedMatcher.h>
+#include <SimdMatcher.h>
+
+TileMatcher* TileMatcher::create(MatchMode mode, const MatcherSettings& settings)
+{
+	switch (mode)
+	{
+	case MatchMode::Linear:
+		return new LinearMatcher();
+	case MatchMode::KdTree:
+		return new KdTreeMatcher();
+	case MatchMode::Simd:
+		return new SimdMatcher();
+	case MatchMode::Ivf:
+		return new IvfMatcher(settings);
+	case MatchMode::Pruned:
+		return new PrunedMatcher();
+	}
+	return nullptr;
+}
+
+bool TileMatcher::parseMatchMode(const std::string& name, MatchMode& mode)
+{
+	if (name == "linear")
+		mode = MatchMode::Linear;
+	else if (name == "kdtree")
+		mode = MatchMode::KdTree;
+	else if (name == "simd")
+		mode = MatchMode::Simd;
+	else if (name == "ivf")
+		mode = MatchMode::Ivf;
+	else if (name == "pruned")
+		mode = MatchMode::Pruned;
+	else
+		return false;
+	return true;
+}
+
+uint64_t TileMatcher::hashFeatures(const float* features, size_t numFloats)
+{
+	// FNV-1a over the raw bytes
+	const unsigned char* bytes = reinterpret_cast<const unsigned char*>(features);
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t byteIndex = 0; byteIndex < numFloats * sizeof(float); byteIndex++)
+	{
+		hash ^= bytes[byteIndex];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
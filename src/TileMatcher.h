@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+enum class MatchMode
+{
+	Linear,
+	KdTree,
+	Simd,
+	Ivf,
+	Pruned,
+};
+
+struct MatcherSettings
+{
+	// Threads used to build indexes; 0 means one per hardware thread
+	int numThreads = 0;
+	// Clusters of the inverted file index, 0 to pick from the number of tiles
+	int ivfNumLists = 0;
+	// Clusters searched per query by the inverted file index
+	int ivfNumProbes = 8;
+};
+
+// Finds the tile whose features are closest to a query, by squared Euclidean distance.
+// Exact implementations return what a linear scan would, including its tie-breaking:
+// among equally distant tiles, the lowest index wins.
+class TileMatcher
+{
+public:
+	virtual ~TileMatcher() = default;
+
+	// features holds numTiles rows of dimension floats, and must outlive the matcher
+	virtual void build(const float* features, int numTiles, int dimension) = 0;
+	virtual int findNearest(const float* query) const = 0;
+	// The numNearest closest tiles, at most MAX_NEAREST_TILES, from closest to farthest with
+	// the same tie-breaking as findNearest. Returns how many were written, fewer only when
+	// there are fewer tiles or, for approximate indexes, fewer candidates were searched.
+	virtual int findNearest(const float* query, int numNearest, int* nearestTileIndices) const = 0;
+	virtual const char* getName() const = 0;
+
+	// Indexes that take long to build can be kept in a file. featuresHash identifies the
+	// features they were built from, reading fails if it differs.
+	virtual bool canBeSaved() const { return false; }
+	virtual bool read(const std::filesystem::path& /*path*/, const float* /*features*/, int /*numTiles*/,
+		int /*dimension*/, uint64_t /*featuresHash*/) { return false; }
+	virtual bool write(const std::filesystem::path& /*path*/, uint64_t /*featuresHash*/) const { return false; }
+
+	static TileMatcher* create(MatchMode mode, const MatcherSettings& settings);
+	static bool parseMatchMode(const std::string& name, MatchMode& mode);
+	static uint64_t hashFeatures(const float* features, size_t numFloats);
+
+	// Summed in dimension order, which makes it bit-identical to Pixel::dist for RGBA
+	static float squaredDistance(const float* a, const float* b, int dimension)
+	{
+		float distance = 0.0f;
+		for (int d = 0; d < dimension; d++)
+		{
+			const float difference = a[d] - b[d];
+			distance += difference * difference;
+		}
+		return distance;
+	}
+};
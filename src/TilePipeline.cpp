@@ -0,0 +1,291 @@
+#include <TilePipeline.h>
+
+#include <BoundedQueue.h>
+#include <FileReader.h>
+#include <Image.h>
+#include <Parallel.h>
+#include <Pixel.h>
+#include <TileAtlas.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+
+// Queued items per consumer thread, enough to hide jitter without piling up memory
+#define ITEMS_IN_FLIGHT_PER_THREAD 2
+#define MAX_READER_THREADS 4
+// Read, decode and crop; a smaller thread budget runs them one after the other per file
+#define NUM_STAGES 3
+// Files kept in flight by the io_uring reader
+#define IO_URING_QUEUE_DEPTH 32
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	struct FileContents
+	{
+		int fileIndex = -1;
+		std::vector<unsigned char> bytes;
+	};
+
+	struct DecodedImage
+	{
+		int fileIndex = -1;
+		Image image;
+	};
+
+	// Work done by one stage, summed over its threads
+	struct StageStats
+	{
+		const char* name = nullptr;
+		int numThreads = 0;
+		std::atomic<int64_t> numItems{0};
+		std::atomic<int64_t> numBytes{0};
+		std::atomic<int64_t> busyNanoseconds{0};
+		// Time from the pipeline start until the last thread of the stage finished
+		std::atomic<int64_t> wallNanoseconds{0};
+
+		void addItem(Clock::time_point startTime, int64_t bytes)
+		{
+			numItems++;
+			numBytes += bytes;
+			busyNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - startTime).count();
+		}
+
+		void report() const
+		{
+			const double wallSeconds = double(wallNanoseconds) * 1e-9;
+			const double busySeconds = double(busyNanoseconds) * 1e-9;
+			const double itemsPerSecond = wallSeconds > 0.0 ? double(numItems) / wallSeconds : 0.0;
+			const double busyPercent = wallSeconds > 0.0 ? 100.0 * busySeconds / (wallSeconds * numThreads) : 0.0;
+
+			std::ostringstream message;
+			message.precision(1);
+			message << std::fixed << name << " stage: " << numItems << " items, " <<
+				double(numBytes) / (1024.0 * 1024.0) << " MB, " << itemsPerSecond << " items/s (" <<
+				numThreads << " threads, " << busyPercent << "% busy)." << std::endl;
+			std::cout << message.str();
+		}
+	};
+
+	// Start numThreads threads running work; the last one to finish calls onStageDone
+	void startStage(std::vector<std::thread>& threads, StageStats& stats, Clock::time_point pipelineStartTime,
+		const std::function<void()>& work, const std::function<void()>& onStageDone)
+	{
+		auto numThreadsRunning = std::make_shared<std::atomic<int>>(stats.numThreads);
+		for (int threadIndex = 0; threadIndex < stats.numThreads; threadIndex++)
+		{
+			threads.emplace_back([&stats, pipelineStartTime, work, onStageDone, numThreadsRunning]()
+			{
+				work();
+				if (--*numThreadsRunning == 0)
+				{
+					stats.wallNanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(
+						Clock::now() - pipelineStartTime).count();
+					onStageDone();
+				}
+			});
+		}
+	}
+}
+
+void TilePipeline::setTileSize(int size)
+{
+	assert(size > 0);
+
+	tileSize = size;
+}
+
+void TilePipeline::setNumThreads(int n)
+{
+	assert(n >= 0);
+
+	numThreads = n;
+}
+
+void TilePipeline::setUseExifThumbnails(bool useThumbnails)
+{
+	useExifThumbnails = useThumbnails;
+}
+
+void TilePipeline::setUseIoUring(bool useRing)
+{
+	useIoUring = useRing;
+}
+
+void TilePipeline::run(const std::vector<TileSourceFile>& sourceFiles, const std::vector<int>& fileIndices,
+	TileAtlas& atlas, Pixel* means, std::vector<char>& isTileLoaded) const
+{
+	assert(tileSize > 0);
+	assert(atlas.getTileSize() == tileSize);
+
+	const int numFiles = int(fileIndices.size());
+	if (numFiles == 0)
+		return;
+
+	const int numBudgetThreads = numThreads > 0 ? numThreads : getDefaultNumThreads();
+	StageStats readStats;
+	readStats.name = "Read";
+	StageStats decodeStats;
+	decodeStats.name = "Decode";
+	StageStats cropStats;
+	cropStats.name = "Crop";
+
+	// Work on one file in each stage, shared by the staged and the inline runs
+	auto readFile = [&](int fileIndex, FileContents& contents)
+	{
+		const Clock::time_point itemStartTime = Clock::now();
+		contents.fileIndex = fileIndex;
+		if (!FileReader::readFile(sourceFiles[fileIndex].path, contents.bytes))
+		{
+			std::cerr << "Could not read file '" << sourceFiles[fileIndex].path.native() << "'." << std::endl;
+			return false;
+		}
+		readStats.addItem(itemStartTime, int64_t(contents.bytes.size()));
+		return true;
+	};
+
+	auto decodeFile = [&](FileContents& contents, DecodedImage& decoded)
+	{
+		// Tiles are tiny, decode no more pixels than the crop needs, and let the crop
+		// apply the orientation rather than reorienting the whole image
+		const Clock::time_point itemStartTime = Clock::now();
+		decoded.fileIndex = contents.fileIndex;
+		const std::string& name = sourceFiles[contents.fileIndex].path.native();
+		if (!decoded.image.loadFromMemory(contents.bytes.data(), contents.bytes.size(), name.c_str(),
+			tileSize, useExifThumbnails, true))
+			return false;
+
+		// Release the encoded bytes before waiting on the next stage
+		contents.bytes = std::vector<unsigned char>();
+		decodeStats.addItem(itemStartTime, decoded.image.sizeInBytes());
+		return true;
+	};
+
+	// Each file owns the slot at its own index, so croppers never share writes
+	auto cropImage = [&](DecodedImage& decoded, Image& tileImage)
+	{
+		const Clock::time_point itemStartTime = Clock::now();
+		const int fileIndex = decoded.fileIndex;
+		decoded.image.cropToSquare(tileImage, tileSize, tileSize);
+		decoded.image.reset();
+
+		// The mean is taken before the tile is converted to the channels of the atlas
+		tileImage.computeTileMean(means[fileIndex], 0, 0, tileSize);
+		atlas.setTile(fileIndex, tileImage);
+		isTileLoaded[fileIndex] = 1;
+		cropStats.addItem(itemStartTime, atlas.tileSizeInBytes());
+	};
+
+	const Clock::time_point startTime = Clock::now();
+
+	// Too few threads to give each stage its own, so every thread takes files through all of them
+	if (numBudgetThreads < NUM_STAGES)
+	{
+		const int numInlineThreads = std::min(numBudgetThreads, numFiles);
+		parallelFor(numFiles, numInlineThreads, [&](int taskIndex)
+		{
+			FileContents contents;
+			DecodedImage decoded;
+			Image tileImage;
+			if (readFile(fileIndices[taskIndex], contents) && decodeFile(contents, decoded))
+				cropImage(decoded, tileImage);
+		});
+
+		const int64_t wallNanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			Clock::now() - startTime).count();
+		for (StageStats* stats : { &readStats, &decodeStats, &cropStats })
+		{
+			stats->numThreads = numInlineThreads;
+			stats->wallNanoseconds = wallNanoseconds;
+			stats->report();
+		}
+		return;
+	}
+
+	// The thread budget is split across the stages rather than given to each of them.
+	// Readers mostly wait on storage: a single one drives the ring when available,
+	// otherwise up to a quarter of the budget keeps several blocking reads in flight.
+	// Once decoding happens at reduced scale, resampling to a tile costs about as much,
+	// so decoders and croppers share the rest evenly.
+	FileReader fileReader;
+	const bool isUsingIoUring = useIoUring && fileReader.initIoUring(std::min(IO_URING_QUEUE_DEPTH, numFiles));
+	const int numReadThreads = isUsingIoUring ? 1 : std::min({ std::max(1, numBudgetThreads / 4), MAX_READER_THREADS, numFiles });
+	const int numWorkThreads = std::max(0, numBudgetThreads - numReadThreads);
+	if (isUsingIoUring)
+		readStats.name = "Read (io_uring)";
+	readStats.numThreads = numReadThreads;
+	decodeStats.numThreads = std::min(std::max(1, numWorkThreads - numWorkThreads / 2), numFiles);
+	cropStats.numThreads = std::min(std::max(1, numWorkThreads / 2), numFiles);
+
+	BoundedQueue<FileContents> readQueue(size_t(ITEMS_IN_FLIGHT_PER_THREAD * decodeStats.numThreads));
+	BoundedQueue<DecodedImage> decodedQueue(size_t(ITEMS_IN_FLIGHT_PER_THREAD * cropStats.numThreads));
+	std::atomic<int> nextReadIndex(0);
+	std::vector<std::thread> threads;
+
+	startStage(threads, readStats, startTime, [&]()
+	{
+		if (isUsingIoUring)
+		{
+			// Time spent waiting on the ring counts towards the item it delivers,
+			// time blocked on a full queue does not
+			Clock::time_point itemStartTime = Clock::now();
+			fileReader.readFiles(sourceFiles, fileIndices, [&](int fileIndex, std::vector<unsigned char>& bytes)
+			{
+				FileContents contents;
+				contents.fileIndex = fileIndex;
+				contents.bytes = std::move(bytes);
+				readStats.addItem(itemStartTime, int64_t(contents.bytes.size()));
+				readQueue.push(std::move(contents));
+				itemStartTime = Clock::now();
+			});
+			return;
+		}
+
+		for (int taskIndex = nextReadIndex++; taskIndex < numFiles; taskIndex = nextReadIndex++)
+		{
+			FileContents contents;
+			if (readFile(fileIndices[taskIndex], contents))
+				readQueue.push(std::move(contents));
+		}
+	},
+	[&]() { readQueue.close(); });
+
+	startStage(threads, decodeStats, startTime, [&]()
+	{
+		FileContents contents;
+		while (readQueue.pop(contents))
+		{
+			DecodedImage decoded;
+			if (decodeFile(contents, decoded))
+				decodedQueue.push(std::move(decoded));
+		}
+	},
+	[&]() { decodedQueue.close(); });
+
+	startStage(threads, cropStats, startTime, [&]()
+	{
+		DecodedImage decoded;
+		Image tileImage;
+		while (decodedQueue.pop(decoded))
+			cropImage(decoded, tileImage);
+	},
+	[]() {});
+
+	for (std::thread& thread : threads)
+		thread.join();
+
+	readStats.report();
+	decodeStats.report();
+	cropStats.report();
+}
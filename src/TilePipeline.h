@@ -0,0 +1,34 @@
+#pragma once
+
+#include <TileCache.h>
+
+#include <vector>
+
+class TileAtlas;
+struct Pixel;
+
+// Staged tile ingestion: reader threads prefetch file contents, decoders turn them
+// into images, and croppers cut those down to tiles. Bounded queues between the
+// stages apply backpressure, so no more than a few files are in flight at a time.
+// A thread budget below the number of stages runs them one after the other for each
+// file instead, on the budgeted threads only.
+class TilePipeline
+{
+public:
+	void setTileSize(int size);
+	void setNumThreads(int n);
+	void setUseExifThumbnails(bool useThumbnails);
+	void setUseIoUring(bool useRing);
+
+	// Build tile i of the atlas and means[i] from sourceFiles[i] for every i in fileIndices,
+	// and set isTileLoaded[i] for those that could be decoded
+	void run(const std::vector<TileSourceFile>& sourceFiles, const std::vector<int>& fileIndices,
+		TileAtlas& atlas, Pixel* means, std::vector<char>& isTileLoaded) const;
+
+private:
+	int tileSize = 0;
+	int numThreads = 0;
+	bool useExifThumbnails = false;
+	// Read files through io_uring when the kernel supports it
+	bool useIoUring = true;
+};
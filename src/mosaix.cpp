@@ -1,11 +1,14 @@
 
 #include <Image.h>
 #include <Mosaic.h>
+#include <NearestTiles.h>
 
 #include <cassert>
+#include <cstdint>
 #include <filesystem>
 #include <iostream>
 #include <string>
+#include <vector>
 
 struct App
 {
@@ -64,22 +67,138 @@ private:
 	std::filesystem::path folderPath;
 	float scaling = 1.0f;
 	int tileSize = -1.0f;
+	int numThreads = 0;
+	std::filesystem::path cachePath;
+	bool useExifThumbnails = false;
+	bool useIoUring = true;
+	MatchMode matchMode = MatchMode::KdTree;
+	ColourSpace colourSpace = ColourSpace::Rgb;
+	int descriptorGridSize = 1;
+	int pcaDimension = 0;
+	int lutResolution = 0;
+	int ivfNumLists = 0;
+	int ivfNumProbes = 8;
+	int numCandidates = 1;
+	uint32_t randomSeed = 0;
+	int maxTileUses = 0;
+	AssignmentMethod assignmentMethod = AssignmentMethod::Greedy;
+	int repeatRadius = 0;
+	bool useMatchCache = true;
+	bool checkMatches = false;
 
 public:
 	void setArgs(int argc, char *argv[]) override
 	{
-		assert(argc > 2);
-		imagePath = argv[1];
-		folderPath = argv[2];
-		if (argc > 3)
+		// Options may appear anywhere, everything else is positional
+		std::vector<std::string> args;
+		for (int argIndex = 1; argIndex < argc; argIndex++)
+		{
+			const std::string arg = argv[argIndex];
+			if (arg == "--threads" && argIndex + 1 < argc)
+			{
+				numThreads = std::stoi(argv[++argIndex]);
+				numThreads = numThreads < 0 ? 0 : numThreads;
+			}
+			else if (arg == "--cache" && argIndex + 1 < argc)
+			{
+				cachePath = argv[++argIndex];
+			}
+			else if (arg == "--thumbnails")
+			{
+				useExifThumbnails = true;
+			}
+			else if (arg == "--no-io-uring")
+			{
+				useIoUring = false;
+			}
+			else if (arg == "--match" && argIndex + 1 < argc)
+			{
+				if (!TileMatcher::parseMatchMode(argv[++argIndex], matchMode))
+					std::cerr << "Unknown match mode '" << argv[argIndex] << "', using the default." << std::endl;
+			}
+			else if (arg == "--colour-space" && argIndex + 1 < argc)
+			{
+				if (!parseColourSpace(argv[++argIndex], colourSpace))
+					std::cerr << "Unknown colour space '" << argv[argIndex] << "', using the default." << std::endl;
+			}
+			else if (arg == "--grid" && argIndex + 1 < argc)
+			{
+				descriptorGridSize = std::stoi(argv[++argIndex]);
+				descriptorGridSize = descriptorGridSize < 1 ? 1 : descriptorGridSize;
+				descriptorGridSize = descriptorGridSize > 8 ? 8 : descriptorGridSize;
+			}
+			else if (arg == "--pca" && argIndex + 1 < argc)
+			{
+				pcaDimension = std::stoi(argv[++argIndex]);
+				pcaDimension = pcaDimension < 0 ? 0 : pcaDimension;
+			}
+			else if (arg == "--ivf-lists" && argIndex + 1 < argc)
+			{
+				ivfNumLists = std::stoi(argv[++argIndex]);
+				ivfNumLists = ivfNumLists < 0 ? 0 : ivfNumLists;
+			}
+			else if (arg == "--ivf-probes" && argIndex + 1 < argc)
+			{
+				ivfNumProbes = std::stoi(argv[++argIndex]);
+				ivfNumProbes = ivfNumProbes < 1 ? 1 : ivfNumProbes;
+			}
+			else if (arg == "--lut" && argIndex + 1 < argc)
+			{
+				lutResolution = std::stoi(argv[++argIndex]);
+				lutResolution = lutResolution < 0 ? 0 : lutResolution;
+				lutResolution = lutResolution > 256 ? 256 : lutResolution;
+			}
+			else if (arg == "--candidates" && argIndex + 1 < argc)
+			{
+				numCandidates = std::stoi(argv[++argIndex]);
+				numCandidates = numCandidates < 1 ? 1 : numCandidates;
+				numCandidates = numCandidates > MAX_NEAREST_TILES ? MAX_NEAREST_TILES : numCandidates;
+			}
+			else if (arg == "--seed" && argIndex + 1 < argc)
+			{
+				randomSeed = uint32_t(std::stoul(argv[++argIndex]));
+			}
+			else if (arg == "--max-uses" && argIndex + 1 < argc)
+			{
+				maxTileUses = std::stoi(argv[++argIndex]);
+				maxTileUses = maxTileUses < 0 ? 0 : maxTileUses;
+			}
+			else if (arg == "--assignment" && argIndex + 1 < argc)
+			{
+				if (!TileAssignment::parseAssignmentMethod(argv[++argIndex], assignmentMethod))
+					std::cerr << "Unknown assignment method '" << argv[argIndex] << "', using the default." << std::endl;
+			}
+			else if (arg == "--repeat-radius" && argIndex + 1 < argc)
+			{
+				repeatRadius = std::stoi(argv[++argIndex]);
+				repeatRadius = repeatRadius < 0 ? 0 : repeatRadius;
+			}
+			else if (arg == "--no-match-cache")
+			{
+				useMatchCache = false;
+			}
+			else if (arg == "--check-matches")
+			{
+				checkMatches = true;
+			}
+			else
+			{
+				args.push_back(arg);
+			}
+		}
+
+		assert(args.size() > 1);
+		imagePath = args[0];
+		folderPath = args[1];
+		if (args.size() > 2 && !args[2].empty())
 		{
-			scaling = std::stof(argv[3]);
+			scaling = std::stof(args[2]);
 			scaling = scaling <= 0.01f ? 0.01f : scaling;
 			scaling = scaling > 10.0f ? 10.0f : scaling;
 		}
-		if (argc > 4)
+		if (args.size() > 3 && !args[3].empty())
 		{
-			tileSize = std::stoi(argv[4]);
+			tileSize = std::stoi(args[3]);
 			tileSize = tileSize < 1 ? 1 : tileSize;
 			tileSize = tileSize > 4096 ? 4096 : tileSize;
 		}
@@ -93,6 +212,22 @@ public:
 		Mosaic mosaic;
 		mosaic.setTileSize(tileSize);
 		mosaic.setScaling(scaling);
+		mosaic.setNumThreads(numThreads);
+		mosaic.setTileCachePath(cachePath);
+		mosaic.setUseExifThumbnails(useExifThumbnails);
+		mosaic.setUseIoUring(useIoUring);
+		mosaic.setMatchMode(matchMode);
+		mosaic.setColourSpace(colourSpace);
+		mosaic.setDescriptorGridSize(descriptorGridSize);
+		mosaic.setPcaDimension(pcaDimension);
+		mosaic.setIvfParameters(ivfNumLists, ivfNumProbes);
+		mosaic.setLutResolution(lutResolution);
+		mosaic.setRandomPick(numCandidates, randomSeed);
+		mosaic.setMaxTileUses(maxTileUses);
+		mosaic.setAssignmentMethod(assignmentMethod);
+		mosaic.setRepeatRadius(repeatRadius);
+		mosaic.setUseMatchCache(useMatchCache);
+		mosaic.setCheckMatches(checkMatches);
 		mosaic.setSourceImage(imagePath);
 		mosaic.setTilesFolder(folderPath);
 		Image mosaicImage;
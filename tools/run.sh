@@ -4,11 +4,29 @@ usageDisplayed=0
 usage()
 {
 	if [[ "${usageDisplayed}" -eq 0 ]]; then
-		echo "usage: $0 source_image source_dir [-s scaling] [-t tileSize] [-h|--help] [-p|--profile]"
+		echo "usage: $0 source_image source_dir [-s scaling] [-t tileSize] [-j threads] [-c cacheFile] [-e] [-u] [-m matchMode] [-i lists] [-n probes] [-o colourSpace] [-g gridSize] [-d dimensions] [-l resolution] [-r candidates] [-x seed] [-b maxUses] [-a method] [-w radius] [-f] [-k] [-h|--help] [-p|--profile]"
 		echo "  Builds and runs the mosaix executable with 'source_image' and 'source_dir' as inputs."
 		echo "options:"
 		echo "  -s scaling    Applies 'scaling' factor to the output image size."
 		echo "  -t tileSize   Sets 'tileSize' as the size of image tiles."
+		echo "  -j threads    Uses 'threads' worker threads (default: one per core)."
+		echo "  -c cacheFile  Loads tiles from 'cacheFile' when up to date, and saves them to it otherwise."
+		echo "  -e            Builds tiles from embedded EXIF thumbnails when large enough."
+		echo "  -u            Reads tile files with pread even where io_uring is available."
+		echo "  -m matchMode  Searches tiles with 'matchMode': linear, pruned, kdtree (default), simd or ivf."
+		echo "  -i lists      Groups tiles in 'lists' clusters with the ivf match mode (default: from the tile count)."
+		echo "  -n probes     Searches the 'probes' closest clusters with the ivf match mode (default: 8)."
+		echo "  -o colourSpace Compares colours in 'colourSpace': rgb (default) or oklab."
+		echo "  -g gridSize   Compares the means of a 'gridSize' x 'gridSize' grid per tile (default: 1)."
+		echo "  -d dimensions Projects grid descriptors to 'dimensions' by PCA before searching."
+		echo "  -l resolution Looks tiles up in a colour table with 'resolution' cells per axis, 256 is exact."
+		echo "  -r candidates Picks each tile at random among the 'candidates' closest (default: 1)."
+		echo "  -x seed       Seeds the random pick with 'seed' (default: 0)."
+		echo "  -b maxUses    Uses each tile at most 'maxUses' times over the whole mosaic (default: no limit)."
+		echo "  -a method     Shares limited uses out with 'method': greedy (default) or auction, which minimizes the total distance."
+		echo "  -w radius     Keeps any tile from appearing twice within 'radius' cells (default: 0, tiles may repeat)."
+		echo "  -f            Searches every cell, even when an identical one was matched before."
+		echo "  -k            Compares matches with an exhaustive search and reports the difference."
 		echo "  -h|--help     Prints this message."
 		echo "  -p|--profile  Time the execution."
 		usageDisplayed=1
@@ -27,6 +45,7 @@ execute()
 
 scaling=1
 tileSize=
+extraArgs=()
 sourceImage=
 sourceDir=
 
@@ -58,6 +77,186 @@ while [[ $# -gt 0 ]]; do
 		fi
 		shift
 		;;
+		-j)
+		shift
+		re='^[0-9]+$'
+		if [[ "$1" =~ $re ]]; then
+			extraArgs+=(--threads "$1")
+		else
+			echo "Input thread count \"$1\" not an integer." 1>&2
+			echo
+			usage
+		fi
+		shift
+		;;
+		-c)
+		shift
+		if [[ -n "$1" ]]; then
+			extraArgs+=(--cache "$1")
+		else
+			echo "No cache file provided." 1>&2
+			echo
+			usage
+		fi
+		shift
+		;;
+		-e)
+		extraArgs+=(--thumbnails)
+		shift
+		;;
+		-u)
+		extraArgs+=(--no-io-uring)
+		shift
+		;;
+		-o)
+		shift
+		if [[ -n "$1" ]]; then
+			extraArgs+=(--colour-space "$1")
+		else
+			echo "No colour space provided." 1>&2
+			echo
+			usage
+		fi
+		shift
+		;;
+		-g)
+		shift
+		re='^[0-9]+$'
+		if [[ "$1" =~ $re ]]; then
+			extraArgs+=(--grid "$1")
+		else
+			echo "Input grid size \"$1\" not an integer." 1>&2
+			echo
+			usage
+		fi
+		shift
+		;;
+		-d)
+		shift
+		re='^[0-9]+$'
+		if [[ "$1" =~ $re ]]; then
+			extraArgs+=(--pca "$1")
+		else
+			echo "Input dimension count \"$1\" not an integer." 1>&2
+			echo
+			usage
+		fi
+		shift
+		;;
+		-l)
+		shift
+		re='^[0-9]+$'
+		if [[ "$1" =~ $re ]]; then
+			extraArgs+=(--lut "$1")
+		else
+			echo "Input lookup table resolution \"$1\" not an integer." 1>&2
+			echo
+			usage
+		fi
+		shift
+		;;
+		-r)
+		shift
+		re='^[0-9]+$'
+		if [[ "$1" =~ $re ]]; then
+			extraArgs+=(--candidates "$1")
+		else
+			echo "Input candidate count \"$1\" not an integer." 1>&2
+			echo
+			usage
+		fi
+		shift
+		;;
+		-x)
+		shift
+		re='^[0-9]+$'
+		if [[ "$1" =~ $re ]]; then
+			extraArgs+=(--seed "$1")
+		else
+			echo "Input seed \"$1\" not an integer." 1>&2
+			echo
+			usage
+		fi
+		shift
+		;;
+		-b)
+		shift
+		re='^[0-9]+$'
+		if [[ "$1" =~ $re ]]; then
+			extraArgs+=(--max-uses "$1")
+		else
+			echo "Input use count \"$1\" not an integer." 1>&2
+			echo
+			usage
+		fi
+		shift
+		;;
+		-a)
+		shift
+		if [[ -n "$1" ]]; then
+			extraArgs+=(--assignment "$1")
+		else
+			echo "No assignment method provided." 1>&2
+			echo
+			usage
+		fi
+		shift
+		;;
+		-w)
+		shift
+		re='^[0-9]+$'
+		if [[ "$1" =~ $re ]]; then
+			extraArgs+=(--repeat-radius "$1")
+		else
+			echo "Input repetition radius \"$1\" not an integer." 1>&2
+			echo
+			usage
+		fi
+		shift
+		;;
+		-f)
+		extraArgs+=(--no-match-cache)
+		shift
+		;;
+		-k)
+		extraArgs+=(--check-matches)
+		shift
+		;;
+		-m)
+		shift
+		if [[ -n "$1" ]]; then
+			extraArgs+=(--match "$1")
+		else
+			echo "No match mode provided." 1>&2
+			echo
+			usage
+		fi
+		shift
+		;;
+		-i)
+		shift
+		re='^[0-9]+$'
+		if [[ "$1" =~ $re ]]; then
+			extraArgs+=(--ivf-lists "$1")
+		else
+			echo "Input list count \"$1\" not an integer." 1>&2
+			echo
+			usage
+		fi
+		shift
+		;;
+		-n)
+		shift
+		re='^[0-9]+$'
+		if [[ "$1" =~ $re ]]; then
+			extraArgs+=(--ivf-probes "$1")
+		else
+			echo "Input probe count \"$1\" not an integer." 1>&2
+			echo
+			usage
+		fi
+		shift
+		;;
 		-h|--help)
 		usage
 		shift
@@ -128,4 +327,4 @@ if [[ ! -f "${execName}" ]]; then
 fi
 
 # Run
-execute "${execName}" "${sourceImage}" "${sourceDir}" "${scaling}" "${tileSize}"
+execute "${execName}" "${sourceImage}" "${sourceDir}" "${scaling}" "${tileSize}" "${extraArgs[@]}"